@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+// What a simulation run (src/sim) saw, for the tests in test/test_sim. Counts are for this run only,
+// the firmware's own counters keep going between runs in the same process.
+struct SimResult
+{
+    uint32_t frames;             // RC frames sent to the first receiver
+    uint32_t corrupted;          // of those, hit by --noise
+    uint32_t split;              // of those, paused halfway by --split
+    uint32_t packets;            // RC packets sent to either receiver
+    uint32_t reports;            // joystick reports
+    uint32_t baud;               // where the first receiver's UART ended up
+    int32_t relockMs;            // after --rebaud, -1 if it never locked
+    uint32_t rcDecoded;          // RC frames the first receiver passed while locked to the baud rate
+    uint32_t wholeFrames;        // whole and split RC frames read while locked
+    uint32_t splitFrames;
+    uint32_t gapDrops;           // partial frames dropped at an idle gap while locked
+    uint32_t forwardedRc;        // RC frames in the --forward stream
+    uint32_t forwardedOther;     // other frames in it
+    uint32_t forwardLeftover;    // bytes in it that aren't part of a valid frame
+    uint32_t diversityForwarded; // frames the receivers forwarded between them
+    uint32_t blackboxFrames;     // frames decoded from the --blackbox dump
+    uint32_t blackboxLinks;
+    uint32_t blackboxEvents;
+    uint32_t blackboxSpanMs;     // from its first record to its last
+    bool blackboxMatches;        // the dump ends with the last frame that arrived intact
+};
+
+// The simulation's command line (see src/sim/sim_main.cpp), 0 if all of the run's checks passed.
+// result, if given, is filled in by a simulation run.
+int simMain(int argc, const char *const *argv, SimResult *result = 0);
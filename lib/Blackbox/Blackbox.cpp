@@ -0,0 +1,368 @@
+#include <string.h>
+#include <Hal.h>
+#include "Blackbox.h"
+
+// Worst case of a key, the record behind it and a repeat flushed in front
+static const uint8_t MAX_WRITE = 1 + 4 + 2 * BLACKBOX_CHANNELS + 1 + 5 + 3 + 3 * BLACKBOX_CHANNELS + 1 + 5;
+
+static inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static inline int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+void Blackbox::reset()
+{
+    _head = _tail = 0;
+    _sinceKey = 0;
+    _segFirst = 0;
+    _segCount = 0;
+    _keyed = false;
+    _source = 0;
+    memset(_last, 0, sizeof(_last));
+    _lastUs = 0;
+    _lastDt = 0;
+    _repeat = 0;
+    _hasPrev = false;
+    _prevPending = false;
+    _sampleUs = 0;
+    _linkSeen = 0;
+    _detail = false;
+    _dumping = false;
+    _frames = 0;
+    _repeats = 0;
+    _keys = 0;
+    _droppedSegments = 0;
+    _decimated = 0;
+    _skipped = 0;
+    _encodeMaxUs = 0;
+    _encodeTotalUs = 0;
+}
+
+void Blackbox::putVarint(uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        put((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    put(v);
+}
+
+void Blackbox::putTime(uint32_t us)
+{
+    int32_t dt = us - _lastUs;
+    putVarint(zigzag(dt - _lastDt));
+    _lastDt = dt;
+    _lastUs = us;
+}
+
+void Blackbox::flushRepeat()
+{
+    if (_repeat == 0)
+        return;
+    put(BLACKBOX_TAG_REPEAT);
+    putVarint(_repeat);
+    _repeat = 0;
+}
+
+void Blackbox::dropSegment()
+{
+    _segFirst = (_segFirst + 1) % MAX_SEGMENTS;
+    --_segCount;
+    _tail = _segPos[_segFirst];
+    ++_droppedSegments;
+}
+
+void Blackbox::makeRoom()
+{
+    // The oldest segments go, the one being written stays
+    while (space() < MAX_WRITE && _segCount > 1)
+        dropSegment();
+}
+
+void Blackbox::writeKey(uint32_t us, bool frame)
+{
+    if (_segCount == MAX_SEGMENTS)
+        dropSegment();
+    uint8_t seg = (_segFirst + _segCount++) % MAX_SEGMENTS;
+    _segPos[seg] = _head;
+    _segUs[seg] = us;
+
+    put(BLACKBOX_TAG_KEY | _source | (frame ? BLACKBOX_KEY_FRAME : 0));
+    for (uint8_t i = 0; i < 4; ++i)
+        put(us >> (8 * i));
+    for (uint8_t ch = 0; ch < BLACKBOX_CHANNELS; ++ch)
+    {
+        put(_last[ch]);
+        put(_last[ch] >> 8);
+    }
+    _sinceKey = 0;
+    _keyed = true;
+    _lastUs = us;
+    _lastDt = 0;
+    ++_keys;
+}
+
+bool Blackbox::begin(uint32_t us, bool frame)
+{
+    makeRoom();
+    flushRepeat();
+    if (_keyed && _sinceKey < SEGMENT)
+        return false;
+    writeKey(us, frame);
+    return true;
+}
+
+void Blackbox::writeFrame(const uint16_t *raw, uint8_t source, uint32_t us)
+{
+    _sampleUs = us;
+    if (_keyed && source == _source && memcmp(raw, _last, sizeof(_last)) == 0)
+    {
+        ++_repeat, ++_repeats;
+        return;
+    }
+
+    uint16_t mask = 0;
+    for (uint8_t ch = 0; ch < BLACKBOX_CHANNELS; ++ch)
+        if (raw[ch] != _last[ch])
+            mask |= 1 << ch;
+
+    // A key that is due carries this frame
+    uint16_t prev[BLACKBOX_CHANNELS];
+    memcpy(prev, _last, sizeof(prev));
+    memcpy(_last, raw, sizeof(_last));
+    _source = source;
+    if (!begin(us, true))
+    {
+        put(BLACKBOX_TAG_FRAME | source);
+        putTime(us);
+        putVarint(mask);
+        for (uint8_t ch = 0; mask; ++ch, mask >>= 1)
+            if (mask & 1)
+                putVarint(zigzag((int32_t)raw[ch] - prev[ch]));
+    }
+}
+
+void Blackbox::flushPending()
+{
+    if (!_prevPending)
+        return;
+    writeFrame(_prev, _prevSource, _prevUs);
+    _prevPending = false;
+}
+
+void Blackbox::startDetail(uint32_t us)
+{
+    flushPending();
+    _detail = true;
+    _detailEndUs = us + DETAIL_US;
+}
+
+bool Blackbox::inDetail(uint32_t us)
+{
+    if (_detail && (int32_t)(us - _detailEndUs) >= 0)
+        _detail = false;
+    return _detail;
+}
+
+void Blackbox::onChannels(const uint16_t *raw, uint8_t source, uint32_t us)
+{
+    if (_dumping)
+    {
+        ++_skipped;
+        return;
+    }
+    uint32_t start = micros();
+    ++_frames;
+
+    bool jump = false;
+    if (_hasPrev)
+        for (uint8_t ch = 0; ch < JUMP_CHANNELS; ++ch)
+            if ((raw[ch] > _prev[ch] ? raw[ch] - _prev[ch] : _prev[ch] - raw[ch]) > JUMP)
+                jump = true;
+    if (jump)
+        startDetail(us);
+
+    _prevPending = _hasPrev && !inDetail(us) && (int32_t)(us - _sampleUs) < (int32_t)SAMPLE_US;
+    if (_prevPending)
+        ++_decimated;
+    else
+        writeFrame(raw, source, us);
+    memcpy(_prev, raw, sizeof(_prev));
+    _prevSource = source;
+    _prevUs = us;
+    _hasPrev = true;
+
+    uint32_t elapsed = micros() - start;
+    _encodeTotalUs += elapsed;
+    if (elapsed > _encodeMaxUs)
+        _encodeMaxUs = elapsed;
+}
+
+void Blackbox::onLinkStatistics(uint8_t receiver, const void *link, uint32_t us)
+{
+    if (_dumping)
+    {
+        ++_skipped;
+        return;
+    }
+    if (receiver < LINK_RECEIVERS && !inDetail(us))
+    {
+        if ((_linkSeen & (1 << receiver)) && (int32_t)(us - _linkUs[receiver]) < (int32_t)LINK_SAMPLE_US)
+        {
+            ++_decimated;
+            return;
+        }
+        _linkSeen |= 1 << receiver;
+        _linkUs[receiver] = us;
+    }
+    begin(us);
+    put(BLACKBOX_TAG_LINK | receiver);
+    putTime(us);
+    const uint8_t *bytes = (const uint8_t *)link;
+    for (uint8_t i = 0; i < BLACKBOX_LINK_SIZE; ++i)
+        put(bytes[i]);
+}
+
+void Blackbox::onEvent(uint8_t event, uint8_t arg, uint32_t us)
+{
+    if (_dumping)
+    {
+        ++_skipped;
+        return;
+    }
+    startDetail(us);
+    begin(us);
+    put(BLACKBOX_TAG_EVENT | event);
+    putTime(us);
+    put(arg);
+}
+
+void Blackbox::startDump()
+{
+    // The last frame and the repeat count are part of the log, the key isn't needed for the count
+    flushPending();
+    makeRoom();
+    flushRepeat();
+
+    uint16_t len = used();
+    memcpy(_header, BLACKBOX_MAGIC, sizeof(BLACKBOX_MAGIC));
+    _header[4] = BLACKBOX_VERSION;
+    _header[5] = len;
+    _header[6] = len >> 8;
+    _headerSent = 0;
+    _dumpTail = _tail;
+    _dumping = true;
+}
+
+const uint8_t *Blackbox::peek(size_t *len)
+{
+    if (!_dumping)
+    {
+        *len = 0;
+        return _buf;
+    }
+    if (_headerSent < sizeof(_header))
+    {
+        *len = sizeof(_header) - _headerSent;
+        return &_header[_headerSent];
+    }
+    *len = (_head >= _dumpTail) ? _head - _dumpTail : BUF_SIZE - _dumpTail;
+    return &_buf[_dumpTail];
+}
+
+void Blackbox::consume(size_t len)
+{
+    if (_headerSent < sizeof(_header))
+        _headerSent += len;
+    else
+        _dumpTail = (_dumpTail + len) & (BUF_SIZE - 1);
+    if (_headerSent == sizeof(_header) && _dumpTail == _head)
+        _dumping = false;
+}
+
+BlackboxReader::BlackboxReader(const uint8_t *data, size_t len) :
+    _data(data), _len(len), _pos(sizeof(BLACKBOX_MAGIC) + 3), _us(0), _dt(0), _channels()
+{
+    _valid = len >= _pos && memcmp(data, BLACKBOX_MAGIC, sizeof(BLACKBOX_MAGIC)) == 0 &&
+             data[sizeof(BLACKBOX_MAGIC)] == BLACKBOX_VERSION;
+    if (_valid)
+    {
+        size_t records = data[5] | data[6] << 8;
+        if (_pos + records < _len)
+            _len = _pos + records;
+    }
+}
+
+uint32_t BlackboxReader::varint()
+{
+    uint32_t v = 0;
+    for (uint8_t shift = 0; _pos < _len && shift < 35; shift += 7)
+    {
+        uint8_t b = _data[_pos++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            break;
+    }
+    return v;
+}
+
+void BlackboxReader::time(Record *rec)
+{
+    _dt += unzigzag(varint());
+    _us += _dt;
+    rec->us = _us;
+}
+
+bool BlackboxReader::next(Record *rec)
+{
+    if (!_valid || _pos >= _len)
+        return false;
+
+    uint8_t tag = _data[_pos++];
+    rec->type = tag & BLACKBOX_TAG_TYPE;
+    rec->arg = tag & BLACKBOX_TAG_ARG;
+    rec->us = _us;
+    rec->repeat = 0;
+
+    switch (rec->type)
+    {
+    case BLACKBOX_TAG_KEY:
+        if (_pos + 4 + 2 * BLACKBOX_CHANNELS > _len)
+            return false;
+        _us = _data[_pos] | _data[_pos + 1] << 8 | _data[_pos + 2] << 16 | (uint32_t)_data[_pos + 3] << 24;
+        _pos += 4;
+        _dt = 0;
+        for (uint8_t ch = 0; ch < BLACKBOX_CHANNELS; ++ch, _pos += 2)
+            _channels[ch] = _data[_pos] | _data[_pos + 1] << 8;
+        rec->us = _us;
+        break;
+    case BLACKBOX_TAG_FRAME:
+    {
+        time(rec);
+        uint32_t mask = varint();
+        for (uint8_t ch = 0; mask && ch < BLACKBOX_CHANNELS; ++ch, mask >>= 1)
+            if (mask & 1)
+                _channels[ch] += unzigzag(varint());
+        break;
+    }
+    case BLACKBOX_TAG_REPEAT:
+        rec->repeat = varint();
+        break;
+    case BLACKBOX_TAG_LINK:
+        time(rec);
+        if (_pos + BLACKBOX_LINK_SIZE > _len)
+            return false;
+        memcpy(rec->link, &_data[_pos], BLACKBOX_LINK_SIZE);
+        _pos += BLACKBOX_LINK_SIZE;
+        break;
+    case BLACKBOX_TAG_EVENT:
+        time(rec);
+        if (_pos >= _len)
+            return false;
+        rec->eventArg = _data[_pos++];
+        break;
+    default:
+        return false;
+    }
+    memcpy(rec->channels, _channels, sizeof(_channels));
+    return true;
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// RAM flight recorder of what the joystick got: channel frames, link statistics and events,
+// kept in a ring so the last stretch before "my stick glitched" can be dumped afterwards.
+//
+// Stream layout (what "blackbox dump" sends):
+//   header  "BBOX" + version byte + 16-bit little endian length of the records
+//   records tag byte, bits 7..5 the record type (BLACKBOX_TAG_*), bits 4..0 its argument
+//     KEY    source, BLACKBOX_KEY_FRAME if it stands for a frame (otherwise it repeats the last
+//            channels): 32-bit us, 16 channels 16-bit, all little endian. Every segment starts with one.
+//     FRAME  source: time, varint mask of the channels that changed (bit 0 is channel 1),
+//            zigzag varint difference to the previous value of each of them
+//     REPEAT varint count of sampled frames that were the same as the previous one, their time isn't kept
+//     LINK   receiver: time, the 10 bytes of crsfLinkStatistics_t
+//     EVENT  event: time, argument byte
+//   Times after the key are a zigzag varint of the change in the interval between records,
+//   so a steady frame rate costs one byte.
+// Varints are LEB128, zigzag maps 0, -1, 1, -2 to 0, 1, 2, 3.
+static const uint8_t BLACKBOX_MAGIC[4] = {'B', 'B', 'O', 'X'};
+static const uint8_t BLACKBOX_VERSION = 1;
+static const uint8_t BLACKBOX_CHANNELS = 16;
+static const uint8_t BLACKBOX_LINK_SIZE = 10;
+
+enum eBlackboxTag
+{
+    BLACKBOX_TAG_KEY = 0x20,
+    BLACKBOX_TAG_FRAME = 0x40,
+    BLACKBOX_TAG_REPEAT = 0x60,
+    BLACKBOX_TAG_LINK = 0x80,
+    BLACKBOX_TAG_EVENT = 0xA0,
+    BLACKBOX_TAG_TYPE = 0xE0,
+    BLACKBOX_TAG_ARG = 0x1F,
+    BLACKBOX_KEY_FRAME = 0x10
+};
+
+enum eBlackboxEvent
+{
+    BLACKBOX_LINK_UP,   // argument is the receiver
+    BLACKBOX_LINK_DOWN, // argument is the receiver
+    BLACKBOX_SOURCE,    // argument is the source that drives the joystick now, 0xFF for none
+};
+
+// Recorder. When the ring is full the oldest segment (a key and what follows it, about
+// SEGMENT bytes) makes room, so a dump always starts at a key.
+// To cover minutes instead of seconds, frames are sampled every SAMPLE_US and link statistics
+// every LINK_SAMPLE_US. After an event or a stick glitch (a stick channel moving more than JUMP
+// from one frame to the next) every frame is kept for DETAIL_US, with the frame right before it.
+// The last frame is always written before a dump.
+class Blackbox
+{
+public:
+    static const uint16_t BUF_SIZE = 16384; // power of 2
+    static const uint16_t SEGMENT = 1024;   // bytes between keys
+    static const uint8_t MAX_SEGMENTS = BUF_SIZE / SEGMENT + 2;
+    static const uint32_t SAMPLE_US = 200000;
+    static const uint32_t LINK_SAMPLE_US = 1000000;
+    static const uint32_t DETAIL_US = 2000000;
+    static const uint8_t JUMP_CHANNELS = 4; // the sticks, switches jump by design
+    static const uint16_t JUMP = 128;
+    static const uint8_t LINK_RECEIVERS = 2; // link statistics of other receivers aren't sampled
+
+    Blackbox() { reset(); }
+    // Empty the ring and the counters
+    void reset();
+
+    // The channels that went to the joystick, us is when the frame arrived
+    void onChannels(const uint16_t *raw, uint8_t source, uint32_t us);
+    void onLinkStatistics(uint8_t receiver, const void *link, uint32_t us);
+    void onEvent(uint8_t event, uint8_t arg, uint32_t us);
+
+    // Dump the log, nothing is recorded until all of it went out through peek() and consume()
+    void startDump();
+    bool dumping() const { return _dumping; }
+    // Contiguous data ready to send
+    const uint8_t *peek(size_t *len);
+    void consume(size_t len);
+
+    uint16_t used() const { return (_head - _tail) & (BUF_SIZE - 1); }
+    // Time covered by the ring, from its oldest key to the last record
+    uint32_t spanUs() const { return _segCount ? _lastUs - _segUs[_segFirst] : 0; }
+    uint32_t getFrames() const { return _frames; }
+    uint32_t getRepeats() const { return _repeats; }
+    uint32_t getKeys() const { return _keys; }
+    uint32_t getDroppedSegments() const { return _droppedSegments; }
+    // Frames and link statistics left out between samples
+    uint32_t getDecimated() const { return _decimated; }
+    // Records that came while a dump was going out
+    uint32_t getSkipped() const { return _skipped; }
+    uint32_t getEncodeMaxUs() const { return _encodeMaxUs; }
+    uint32_t getEncodeMeanNs() const { return _frames ? _encodeTotalUs * 1000 / _frames : 0; }
+
+private:
+    uint8_t _buf[BUF_SIZE];
+    uint16_t _head;
+    uint16_t _tail;
+    uint16_t _sinceKey;
+    uint16_t _segPos[MAX_SEGMENTS]; // start of every segment, oldest at _segFirst
+    uint32_t _segUs[MAX_SEGMENTS];
+    uint8_t _segFirst;
+    uint8_t _segCount;
+    bool _keyed;
+    uint8_t _source;
+    uint16_t _last[BLACKBOX_CHANNELS];
+    uint32_t _lastUs;
+    int32_t _lastDt;
+    uint32_t _repeat;
+
+    uint16_t _prev[BLACKBOX_CHANNELS]; // the frame before, to spot jumps
+    uint8_t _prevSource;
+    uint32_t _prevUs;
+    bool _hasPrev;
+    bool _prevPending; // the frame before wasn't written
+    uint32_t _sampleUs;
+    uint32_t _linkUs[LINK_RECEIVERS];
+    uint8_t _linkSeen; // bit per receiver
+    bool _detail;
+    uint32_t _detailEndUs;
+
+    bool _dumping;
+    uint8_t _header[sizeof(BLACKBOX_MAGIC) + 3];
+    uint8_t _headerSent;
+    uint16_t _dumpTail;
+
+    uint32_t _frames;
+    uint32_t _repeats;
+    uint32_t _keys;
+    uint32_t _droppedSegments;
+    uint32_t _decimated;
+    uint32_t _skipped;
+    uint32_t _encodeMaxUs;
+    uint64_t _encodeTotalUs;
+
+    uint16_t space() const { return BUF_SIZE - 1 - used(); }
+    void put(uint8_t b)
+    {
+        _buf[_head] = b;
+        _head = (_head + 1) & (BUF_SIZE - 1);
+        ++_sinceKey;
+    }
+    void putVarint(uint32_t v);
+    void putTime(uint32_t us);
+    void flushRepeat();
+    void dropSegment();
+    void makeRoom();
+    // Room for a record, and a key in front of it if one is due, true if it got the key
+    bool begin(uint32_t us, bool frame = false);
+    void writeKey(uint32_t us, bool frame);
+    void writeFrame(const uint16_t *raw, uint8_t source, uint32_t us);
+    // Every frame until DETAIL_US from now, the one before goes in first
+    void startDetail(uint32_t us);
+    bool inDetail(uint32_t us);
+    void flushPending();
+};
+
+// Walks a dump, for the host
+class BlackboxReader
+{
+public:
+    struct Record
+    {
+        uint8_t type; // BLACKBOX_TAG_*
+        uint8_t arg;  // source, receiver or event
+        uint32_t us;
+        uint32_t repeat;
+        uint8_t eventArg;
+        uint8_t link[BLACKBOX_LINK_SIZE];
+        uint16_t channels[BLACKBOX_CHANNELS]; // after a KEY or FRAME, and still valid after the others
+    };
+
+    BlackboxReader(const uint8_t *data, size_t len);
+    bool valid() const { return _valid; }
+    bool next(Record *rec);
+
+private:
+    const uint8_t *_data;
+    size_t _len;
+    size_t _pos;
+    uint32_t _us;
+    int32_t _dt;
+    uint16_t _channels[BLACKBOX_CHANNELS];
+    bool _valid;
+
+    uint32_t varint();
+    void time(Record *rec);
+};
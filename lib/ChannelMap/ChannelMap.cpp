@@ -0,0 +1,126 @@
+#include "ChannelMap.h"
+
+ChannelMapper::ChannelMapper(const ChannelMapping *map, uint8_t count, const int16_t *hatAngles) :
+    _map(map), _count(count > MAX_MAPPINGS ? MAX_MAPPINGS : count), _hatAngles(hatAngles), _sticks(), _stickMask(0), _layout(LAYOUT_MAPPED)
+{
+    memset(_positions, NO_POSITION, sizeof(_positions));
+    for (uint8_t i = 0; i < _count; ++i)
+        if (_map[i].target == MAP_AXIS && _map[i].index < CURVE_AXES)
+            _stickMask |= 1 << _map[i].index;
+}
+
+void ChannelMapper::setSticks(const uint16_t *sticks)
+{
+    // Channels 1..4 are X..Xrotate in both layouts
+    uint8_t mask = _layout == LAYOUT_CHANNELS ? (1 << CURVE_AXES) - 1 : _stickMask;
+    for (uint8_t i = 0; i < CURVE_AXES; ++i)
+        if (mask & (1 << i))
+            setAxis(i, sticks[i]);
+}
+
+bool ChannelMapper::setLayout(uint8_t layout)
+{
+#if JOYSTICK_SIZE != 64
+    if (layout == LAYOUT_CHANNELS)
+        return false;
+#endif
+    if (layout >= LAYOUTS)
+        return false;
+
+    _layout = layout;
+    memset(usb_joystick_data, 0, sizeof(usb_joystick_data));
+    // Switches and hats are only written when they change, make the next frame write them all
+    memset(_positions, NO_POSITION, sizeof(_positions));
+#if JOYSTICK_SIZE == 64
+    if (_layout == LAYOUT_CHANNELS)
+        usb_joystick_data[15] = 0xFFFF0000; // all hats centred
+#endif
+    return true;
+}
+
+void ChannelMapper::setCurve(uint8_t axis, const CurveConfig &config)
+{
+    if (axis < CURVE_AXES)
+        _curves[axis].configure(config);
+}
+
+void ChannelMapper::setAxis(uint8_t index, uint16_t value)
+{
+    switch (index)
+    {
+    case 0: Joystick.X(value); break;
+    case 1: Joystick.Y(value); break;
+    case 2: Joystick.Z(value); break;
+    case 3: Joystick.Xrotate(value); break;
+    case 4: Joystick.Yrotate(value); break;
+    case 5: Joystick.Zrotate(value); break;
+    }
+}
+
+void ChannelMapper::applyMapped(const uint16_t *raw, const ChannelTables &tables)
+{
+    for (uint8_t i = 0; i < _count; ++i)
+    {
+        const ChannelMapping &m = _map[i];
+        uint16_t in = raw[m.channel] & 0x7ff;
+
+        if (m.target == MAP_AXIS || m.target == MAP_SLIDER)
+        {
+            uint16_t value = tables.axis[in];
+            if (m.target == MAP_AXIS && m.index < CURVE_AXES)
+                value = applyCurve(m.index, value);
+            if (m.invert)
+                value = AXIS_MAX - value;
+            if (m.target == MAP_AXIS)
+            {
+                if (m.index < CURVE_AXES)
+                    _sticks[m.index] = value;
+                setAxis(m.index, value);
+            }
+            else
+                Joystick.slider(m.index, value);
+            continue;
+        }
+
+        // Switches only touch the report when their position changes
+        uint8_t pos = tables.position[in];
+        if (m.invert)
+            pos = 2 - pos;
+        if (pos == _positions[i])
+            continue;
+        _positions[i] = pos;
+
+        if (m.target == MAP_HAT)
+            Joystick.hat(m.index, _hatAngles[pos]);
+        else
+            for (uint8_t p = 0; p < 3; ++p)
+                Joystick.button(m.index + p, p == pos);
+    }
+}
+
+void ChannelMapper::applyChannels(const uint16_t *raw, const ChannelTables &tables)
+{
+#if JOYSTICK_SIZE == 64
+    // Written straight into the report in one pass: 128 buttons in words 0..3, the 16-bit
+    // axes from word 4 on, X, Y, Z, Xrotate, Yrotate, Zrotate and then the sliders
+    uint16_t *axes = (uint16_t *)&usb_joystick_data[4];
+    uint64_t buttons = 0;
+    for (uint8_t ch = 0; ch < CRSF_NUM_CHANNELS; ++ch)
+    {
+        uint16_t in = raw[ch] & 0x7ff;
+        uint16_t value = tables.axis[in];
+        if (ch < CURVE_AXES)
+        {
+            value = applyCurve(ch, value);
+            _sticks[ch] = value;
+        }
+        axes[ch] = value;
+        if (ch >= CURVE_AXES)
+            buttons |= (uint64_t)1 << ((ch - CURVE_AXES) * 3 + tables.position[in]);
+    }
+    usb_joystick_data[0] = buttons;
+    usb_joystick_data[1] = buttons >> 32;
+#else
+    applyMapped(raw, tables);
+#endif
+}
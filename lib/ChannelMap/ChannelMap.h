@@ -0,0 +1,112 @@
+#pragma once
+
+#include <Hal.h>
+#include <CrsfChannels.h>
+#include "ResponseCurve.h"
+
+// Full scale of a joystick axis, use 1023 with the normal layout in usb_desc.h
+#define AXIS_MAX 65535
+
+enum eMapTarget
+{
+    MAP_AXIS,    // index: 0 X, 1 Y, 2 Z, 3 Xrotate, 4 Yrotate, 5 Zrotate
+    MAP_SLIDER,  // index: slider number
+    MAP_HAT,     // index: hat number, three position switch to hat angle
+    MAP_BUTTONS, // index: first button, three position switch to three buttons
+};
+
+// How channels fill the HID report
+enum eReportLayout
+{
+    LAYOUT_MAPPED,   // through the ChannelMapping description, with the simulator specific hacks
+    LAYOUT_CHANNELS, // channel n is 16-bit axis n (X..Zrotate, then the sliders), no hats, and
+                     // channels 5..16 are three buttons each like MAP_BUTTONS from button 1 on.
+                     // Needs the 64 byte report (JOYSTICK_SIZE 64 in usb_desc.h).
+    LAYOUTS
+};
+
+// One line of the declarative channel to HID description
+struct ChannelMapping
+{
+    uint8_t channel; // 0-based
+    uint8_t target;  // eMapTarget
+    uint8_t index;
+    bool invert;
+};
+
+// How a source's channel values translate to the HID report, for every possible 11-bit
+// input, generated by the compiler from the source's endpoints so a frame costs one
+// lookup per mapping. The tables live in flash.
+struct ChannelTables
+{
+    uint16_t axis[2048];    // 0..AXIS_MAX, clamped
+    uint8_t position[2048]; // three position switch 0..2, clamped
+
+    // Endpoints of the source in its own unit, crsfUs converts raw CRSF values to us first
+    constexpr ChannelTables(long inMin, long inMax, bool crsfUs) : axis(), position()
+    {
+        for (long raw = 0; raw < 2048; ++raw)
+        {
+            long x = crsfUs ? crsfRawToUs(raw) : raw;
+            // map(x, inMin, inMax, 0, AXIS_MAX) and map(x, inMin, inMax, 0, 2) of the Teensy core
+            long value = (x - inMin) * AXIS_MAX / (inMax - inMin);
+            long pos = (x - inMin) * 3 / (inMax - inMin + 1);
+            axis[raw] = value < 0 ? 0 : value > AXIS_MAX ? AXIS_MAX : value;
+            position[raw] = pos < 0 ? 0 : pos > 2 ? 2 : pos;
+        }
+    }
+};
+
+// Applies a mapping description to the joystick
+class ChannelMapper
+{
+public:
+    static const uint8_t MAX_MAPPINGS = 32;
+    static const uint8_t NO_POSITION = 0xFF;
+    static const uint8_t CURVE_AXES = 4; // the sticks, MAP_AXIS index 0..3
+
+    // hatAngles: hat angle for each switch position of MAP_HAT entries
+    ChannelMapper(const ChannelMapping *map, uint8_t count, const int16_t *hatAngles);
+    // raw: 11-bit channel values, tables: the source they came from
+    void apply(const uint16_t *raw, const ChannelTables &tables)
+    {
+        if (_layout == LAYOUT_CHANNELS)
+            applyChannels(raw, tables);
+        else
+            applyMapped(raw, tables);
+    }
+    // Clears the report, the next apply() fills it in the new layout. False if it isn't available.
+    bool setLayout(uint8_t layout);
+    uint8_t getLayout() const { return _layout; }
+
+    // Response curve of a stick axis, rebuilds its table, applied before invert
+    void setCurve(uint8_t axis, const CurveConfig &config);
+    const ResponseCurve &getCurve(uint8_t axis) const { return _curves[axis]; }
+
+    // Stick axes (MAP_AXIS index 0..3) as the last apply() set them, after curve and invert
+    const uint16_t *getSticks() const { return _sticks; }
+    // Overwrite the stick axes of the report, only those the mapping uses
+    void setSticks(const uint16_t *sticks);
+
+private:
+    const ChannelMapping *_map;
+    uint8_t _count;
+    const int16_t *_hatAngles;
+    uint8_t _positions[MAX_MAPPINGS]; // last switch position sent per mapping
+    ResponseCurve _curves[CURVE_AXES];
+    uint16_t _sticks[CURVE_AXES];
+    uint8_t _stickMask; // bit per stick axis that has a mapping
+    uint8_t _layout;
+
+    void applyMapped(const uint16_t *raw, const ChannelTables &tables);
+    void applyChannels(const uint16_t *raw, const ChannelTables &tables);
+    uint16_t applyCurve(uint8_t axis, uint16_t value) const
+    {
+        if (_curves[axis].isLinear())
+            return value;
+        // Curves work on 16 bits, these fold away with the extreme joystick layout
+        return (uint32_t)_curves[axis].apply((uint32_t)value * 65535 / AXIS_MAX) * AXIS_MAX / 65535;
+    }
+
+    static void setAxis(uint8_t index, uint16_t value);
+};
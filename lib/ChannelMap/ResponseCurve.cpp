@@ -0,0 +1,45 @@
+#include "ResponseCurve.h"
+
+ResponseCurve::ResponseCurve()
+{
+    const CurveConfig linear = {0, 0, 0, 100};
+    configure(linear);
+}
+
+void ResponseCurve::configure(const CurveConfig &config)
+{
+    _config = config;
+    if (_config.center < -25)
+        _config.center = -25;
+    if (_config.center > 25)
+        _config.center = 25;
+    if (_config.deadband > 50)
+        _config.deadband = 50;
+    if (_config.expo > 100)
+        _config.expo = 100;
+    if (_config.rate > 200)
+        _config.rate = 200;
+    _linear = _config.center == 0 && _config.deadband == 0 && _config.expo == 0 && _config.rate == 100;
+
+    const float center = 0.5f + _config.center / 100.0f;
+    const float deadband = _config.deadband / 100.0f;
+    const float expo = _config.expo / 100.0f;
+    const float rate = _config.rate / 100.0f;
+
+    for (uint16_t i = 0; i <= SEGMENTS; ++i)
+    {
+        // -1..1 around the (shifted) centre, both ends still reach full travel
+        float in = (float)i / SEGMENTS;
+        float x = (in >= center) ? (in - center) / (1.0f - center) : (in - center) / center;
+
+        float mag = x < 0 ? -x : x;
+        mag = (mag <= deadband) ? 0.0f : (mag - deadband) / (1.0f - deadband);
+        mag = (1.0f - expo) * mag + expo * mag * mag * mag;
+        mag *= rate;
+        if (mag > 1.0f)
+            mag = 1.0f;
+
+        float y = (x < 0 ? -mag : mag) * 0.5f + 0.5f;
+        _lut[i] = (uint16_t)(y * 65535.0f + 0.5f);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+// Stick response settings, all in percent
+struct CurveConfig
+{
+    int8_t center;    // -25..25, shifts the input centre (trim)
+    uint8_t deadband; // 0..50, of half the travel around the centre
+    uint8_t expo;     // 0..100, 0 is linear, 100 is fully cubic
+    uint8_t rate;     // 0..200, output scaling, 100 is full travel
+};
+
+// Response curve over the full axis range, applied through a fixed-point table.
+// The table is rebuilt (with floating point) only by configure(), the per-frame cost
+// is one lookup and a linear interpolation whatever the settings are.
+class ResponseCurve
+{
+public:
+    static const uint16_t SEGMENTS = 256;
+
+    ResponseCurve();
+    // Clamps the settings to their ranges and rebuilds the table
+    void configure(const CurveConfig &config);
+    const CurveConfig &getConfig() const { return _config; }
+    bool isLinear() const { return _linear; }
+
+    // in and result are 0..65535
+    uint16_t apply(uint16_t in) const
+    {
+        uint8_t idx = in >> 8;
+        int32_t lo = _lut[idx];
+        int32_t hi = _lut[idx + 1];
+        return lo + (((hi - lo) * (int32_t)(in & 0xff)) >> 8);
+    }
+
+private:
+    uint16_t _lut[SEGMENTS + 1];
+    CurveConfig _config;
+    bool _linear;
+};
@@ -0,0 +1,91 @@
+#include "StickInterpolator.h"
+
+const char *const StickInterpolator::MODE_NAMES[INTERP_MODES] = {"off", "interpolate", "extrapolate"};
+
+StickInterpolator::StickInterpolator(uint8_t mode, uint16_t maxLead) :
+    _mode(mode < INTERP_MODES ? mode : (uint8_t)INTERP_OFF), _maxLead(maxLead), _rendered(0), _held(0), _limited(0)
+{
+    reset();
+}
+
+void StickInterpolator::setMode(uint8_t mode)
+{
+    if (mode < INTERP_MODES)
+        _mode = mode;
+}
+
+void StickInterpolator::reset()
+{
+    _clock.reset();
+    _frames = 0;
+    _fresh = false;
+    memset(_prev, 0, sizeof(_prev));
+    memset(_cur, 0, sizeof(_cur));
+}
+
+void StickInterpolator::onFrame(const uint16_t *sticks, uint32_t frameUs)
+{
+    _clock.onFrame(frameUs);
+    memcpy(_prev, _cur, sizeof(_prev));
+    memcpy(_cur, sticks, sizeof(_cur));
+    _fresh = true;
+    if (_frames < 2)
+        ++_frames;
+}
+
+bool StickInterpolator::render(uint32_t nowUs, uint16_t *sticks)
+{
+    if (_mode == INTERP_OFF || _frames < 2 || !_clock.isLocked())
+        return false;
+
+    uint32_t phase = _clock.getPhaseQ8(nowUs);
+    if (phase >= HOLD_PHASE_Q8)
+    {
+        // The stream stalled, don't run off along a stale step
+        if (!_fresh && memcmp(_out, _cur, sizeof(_out)) == 0)
+            return false;
+        memcpy(_out, _cur, sizeof(_out));
+        memcpy(sticks, _out, sizeof(_out));
+        _fresh = false;
+        ++_held;
+        return true;
+    }
+    if (phase > 256)
+        phase = 256;
+
+    uint16_t out[AXES];
+    bool limited = false;
+    for (uint8_t i = 0; i < AXES; ++i)
+    {
+        int32_t step = (int32_t)_cur[i] - _prev[i];
+        int32_t value;
+        if (_mode == INTERP_INTERPOLATE)
+            value = _prev[i] + step * (int32_t)phase / 256;
+        else
+        {
+            int32_t lead = step * (int32_t)phase / 256;
+            if (lead > _maxLead || lead < -(int32_t)_maxLead)
+            {
+                lead = lead > 0 ? _maxLead : -(int32_t)_maxLead;
+                limited = true;
+            }
+            value = _cur[i] + lead;
+            if (value < 0 || value > AXIS_MAX)
+            {
+                value = value < 0 ? 0 : AXIS_MAX;
+                limited = true;
+            }
+        }
+        out[i] = value;
+    }
+    if (!_fresh && memcmp(_out, out, sizeof(_out)) == 0)
+        return false;
+
+    memcpy(_out, out, sizeof(_out));
+    memcpy(sticks, _out, sizeof(_out));
+    _fresh = false;
+    ++_rendered;
+    if (limited)
+        ++_limited;
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <FrameClock.h>
+#include "ChannelMap.h"
+
+// Output stage for the stick axes between RC frames, so every USB report gets values for
+// its own time instead of those of the last frame, whatever age that has. The frame period
+// and phase come from a FrameClock, the switches are never touched.
+//  INTERP_OFF          frames go out as they are (the direct path)
+//  INTERP_INTERPOLATE  moves from the previous frame to the last one over a period,
+//                      smooth and never overshoots, but one period behind
+//  INTERP_EXTRAPOLATE  continues from the last frame along its step for up to a period,
+//                      leading by at most maxLead axis units
+// Until the clock is locked, and once the next frame is two periods late, the last frame is held.
+class StickInterpolator
+{
+public:
+    enum eMode
+    {
+        INTERP_OFF,
+        INTERP_INTERPOLATE,
+        INTERP_EXTRAPOLATE,
+        INTERP_MODES
+    };
+    static const char *const MODE_NAMES[INTERP_MODES];
+    static const uint8_t AXES = ChannelMapper::CURVE_AXES;
+    static const uint16_t HOLD_PHASE_Q8 = 2 * 256;
+
+    StickInterpolator(uint8_t mode = INTERP_OFF, uint16_t maxLead = AXIS_MAX / 10);
+    void setMode(uint8_t mode);
+    uint8_t getMode() const { return _mode; }
+    void setMaxLead(uint16_t maxLead) { _maxLead = maxLead; }
+    uint16_t getMaxLead() const { return _maxLead; }
+    // Frames from another source, its clock starts over
+    void reset();
+
+    // Sticks of a frame that started at frameUs, as ChannelMapper::getSticks() has them
+    void onFrame(const uint16_t *sticks, uint32_t frameUs);
+    // Sticks for a report going out at nowUs. False when the frames should go out as they are,
+    // or when nothing changed since the last call and no frame came in
+    bool render(uint32_t nowUs, uint16_t *sticks);
+
+    const FrameClock &getClock() const { return _clock; }
+    uint32_t getRendered() const { return _rendered; }
+    uint32_t getHeld() const { return _held; }
+    uint32_t getLimited() const { return _limited; }
+
+private:
+    FrameClock _clock;
+    uint8_t _mode;
+    uint8_t _frames; // in _prev and _cur, up to 2
+    bool _fresh;     // a frame came in since the last render
+    uint16_t _maxLead;
+    uint16_t _prev[AXES];
+    uint16_t _cur[AXES];
+    uint16_t _out[AXES]; // last rendered
+    uint32_t _rendered;
+    uint32_t _held;
+    uint32_t _limited; // renders with an extrapolation cut to maxLead or the axis range
+};
@@ -0,0 +1,49 @@
+#include "CrsfBaudProbe.h"
+
+// Rates ELRS and TBS receivers are commonly set to
+const uint32_t CrsfBaudProbe::RATES[RATE_COUNT] = {115200, 400000, 420000, 921600, 1870000};
+
+void CrsfBaudProbe::begin(uint32_t baud, uint32_t nowMs)
+{
+    _idx = 0;
+    for (uint8_t i = 0; i < RATE_COUNT; ++i)
+        if (RATES[i] == baud)
+            _idx = i;
+    _hits = 0;
+    _locked = false;
+    _dwellStartMs = nowMs;
+}
+
+bool CrsfBaudProbe::onValidFrame(uint32_t nowMs)
+{
+    _lastHitMs = nowMs;
+    if (_locked || ++_hits < LOCK_HITS)
+        return false;
+
+    _locked = true;
+    ++_locks;
+    return true;
+}
+
+uint32_t CrsfBaudProbe::poll(uint32_t nowMs)
+{
+    if (_locked)
+    {
+        if (nowMs - _lastHitMs <= LOCK_TIMEOUT_MS)
+            return 0;
+        // Lost it, the receiver most likely comes back at the same rate so that one goes first
+        _locked = false;
+        _hits = 0;
+        _dwellStartMs = nowMs;
+        return 0;
+    }
+
+    if (nowMs - _dwellStartMs < DWELL_MS)
+        return 0;
+
+    _idx = (_idx + 1) % RATE_COUNT;
+    _hits = 0;
+    _dwellStartMs = nowMs;
+    ++_switches;
+    return RATES[_idx];
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+// Finds the baud rate of a CRSF receiver. While searching it stays DWELL_MS on each rate of
+// RATES and moves on unless LOCK_HITS frames passed their CRC, at a wrong rate the UART only
+// produces garbage that practically never does. A locked rate is kept until no valid frame
+// arrived for LOCK_TIMEOUT_MS, then the search starts over with the locked rate first.
+// Knows nothing about the UART, the owner applies what poll() returns.
+class CrsfBaudProbe
+{
+public:
+    static const uint8_t RATE_COUNT = 5;
+    static const uint32_t RATES[RATE_COUNT];
+    static const uint16_t DWELL_MS = 100; // at least two frames at 25 Hz
+    static const uint8_t LOCK_HITS = 2;
+    static const uint16_t LOCK_TIMEOUT_MS = 300; // same as the failsafe
+
+    CrsfBaudProbe() : _idx(0), _hits(0), _locked(false), _dwellStartMs(0), _lastHitMs(0), _switches(0), _locks(0) {}
+
+    // Start searching at baud (or the first rate if it is not one of RATES)
+    void begin(uint32_t baud, uint32_t nowMs);
+    // A frame passed its CRC at the current rate, true if that locked it
+    bool onValidFrame(uint32_t nowMs);
+    // Call regularly, returns the rate to switch the UART to or 0 to stay
+    uint32_t poll(uint32_t nowMs);
+
+    uint32_t getBaud() const { return RATES[_idx]; }
+    bool isLocked() const { return _locked; }
+    uint32_t getSwitches() const { return _switches; }
+    uint32_t getLocks() const { return _locks; }
+
+private:
+    uint8_t _idx;
+    uint8_t _hits;
+    bool _locked;
+    uint32_t _dwellStartMs;
+    uint32_t _lastHitMs;
+    uint32_t _switches;
+    uint32_t _locks;
+};
@@ -0,0 +1,3 @@
+#include "CrsfChannels.h"
+
+constexpr CrsfUsTable crsfUsTable;
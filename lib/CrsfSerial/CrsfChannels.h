@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include "crsf_protocol.h"
+
+// Unpack 8 little endian 11-bit channels from 11 bytes with fixed shifts, no branches
+static inline void crsfUnpack8(const uint8_t *p, uint16_t *ch)
+{
+    ch[0] = (p[0]      | p[1] << 8)               & 0x7ff;
+    ch[1] = (p[1] >> 3 | p[2] << 5)               & 0x7ff;
+    ch[2] = (p[2] >> 6 | p[3] << 2 | p[4] << 10)  & 0x7ff;
+    ch[3] = (p[4] >> 1 | p[5] << 7)               & 0x7ff;
+    ch[4] = (p[5] >> 4 | p[6] << 4)               & 0x7ff;
+    ch[5] = (p[6] >> 7 | p[7] << 1 | p[8] << 9)   & 0x7ff;
+    ch[6] = (p[8] >> 2 | p[9] << 6)               & 0x7ff;
+    ch[7] = (p[9] >> 5 | p[10] << 3)              & 0x7ff;
+}
+
+// Unpack a CRSF_FRAMETYPE_RC_CHANNELS_PACKED payload into CRSF_NUM_CHANNELS raw values
+static inline void crsfUnpackChannels(const uint8_t *payload, uint16_t *channels)
+{
+    crsfUnpack8(payload, channels);
+    crsfUnpack8(payload + 11, channels + 8);
+}
+
+// Raw 11-bit channel value to us, same result as
+// map(raw, CRSF_CHANNEL_VALUE_1000, CRSF_CHANNEL_VALUE_2000, 1000, 2000) of the Teensy core
+constexpr uint16_t crsfRawToUs(long raw)
+{
+    return (raw - CRSF_CHANNEL_VALUE_1000) * (2000 - 1000 + 1) / (CRSF_CHANNEL_VALUE_2000 - CRSF_CHANNEL_VALUE_1000 + 1) + 1000;
+}
+
+// crsfRawToUs() for every possible input, computed by the compiler
+struct CrsfUsTable
+{
+    uint16_t us[2048];
+
+    constexpr CrsfUsTable() : us()
+    {
+        for (long raw = 0; raw < 2048; ++raw)
+            us[raw] = crsfRawToUs(raw);
+    }
+};
+
+extern const CrsfUsTable crsfUsTable;
+
+static inline uint16_t crsfChannelToUs(uint16_t raw)
+{
+    return crsfUsTable.us[raw & 0x7ff];
+}
@@ -0,0 +1,29 @@
+#include <string.h>
+#include "CrsfCrc8.h"
+
+constexpr Crc8Table CrsfCrc8::_table(CrsfCrc8::POLY);
+
+uint8_t CrsfCrc8::calc(const uint8_t *data, uint8_t len, uint8_t crc)
+{
+    // Slice-by-4, each little endian word folds 4 bytes with independent lookups
+    const uint8_t (*lut)[256] = _table.lut;
+    while (len >= 4)
+    {
+        uint32_t w;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        memcpy(&w, data, sizeof(w));
+#else
+        // The first byte has to end up in the low bits
+        w = data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+#endif
+        crc = lut[3][(w & 0xff) ^ crc] ^ lut[2][(w >> 8) & 0xff] ^
+              lut[1][(w >> 16) & 0xff] ^ lut[0][w >> 24];
+        data += 4;
+        len -= 4;
+    }
+    while (len--)
+    {
+        crc = lut[0][crc ^ *data++];
+    }
+    return crc;
+}
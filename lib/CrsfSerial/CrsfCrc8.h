@@ -0,0 +1,18 @@
+#pragma once
+
+#include <crc8.h>
+
+// CRSF CRC8 (poly 0xd5), the table is const and shared by every parser so it lives in flash
+class CrsfCrc8
+{
+public:
+    static const uint8_t POLY = 0xd5;
+
+    // Whole buffer, optionally continuing from a previous crc
+    static uint8_t calc(const uint8_t *data, uint8_t len, uint8_t crc = 0);
+    // Incremental, fold one byte into crc
+    static uint8_t update(uint8_t crc, uint8_t b) { return _table.lut[0][crc ^ b]; }
+
+private:
+    static const Crc8Table _table;
+};
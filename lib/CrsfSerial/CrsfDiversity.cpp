@@ -0,0 +1,82 @@
+#include "CrsfDiversity.h"
+
+CrsfDiversity::CrsfDiversity(CrsfSerial *const *receivers, uint8_t count) :
+    _count(count > MAX_RECEIVERS ? MAX_RECEIVERS : count), _selected(NO_RECEIVER),
+    _slotOpen(false), _lastStartUs(0), _lastLq(0), _lastChannels()
+{
+    for (uint8_t i = 0; i < MAX_RECEIVERS; ++i)
+    {
+        Receiver &r = _receivers[i];
+        r.crsf = i < _count ? receivers[i] : NULL;
+        r.frames = r.forwarded = r.tieWins = r.duplicates = 0;
+    }
+}
+
+bool CrsfDiversity::onFrame(uint8_t idx)
+{
+    if (idx >= _count)
+        return false;
+
+    Receiver &r = _receivers[idx];
+    ++r.frames;
+    uint32_t start = r.crsf->getChannelsUs();
+    uint8_t lq = r.crsf->getLinkStatistics()->uplink_Link_quality;
+    r.clock.onFrame(start);
+
+    if (_selected != NO_RECEIVER && _selected != idx)
+    {
+        // Signed so a frame that started before the last one loses
+        int32_t newer = start - _lastStartUs;
+        int32_t windowUs = getWindowUs();
+        bool tie = newer < windowUs && newer > -windowUs && isLastPacket(*r.crsf);
+        if (tie && !_slotOpen)
+        {
+            ++r.duplicates;
+            return false;
+        }
+        if (tie && lq <= _lastLq)
+            return false;
+        if (!tie && newer < 0)
+            return false;
+        if (tie)
+            ++r.tieWins;
+    }
+
+    _slotOpen = true;
+    _lastStartUs = start;
+    _lastLq = lq;
+    for (uint8_t ch = 0; ch < CRSF_NUM_CHANNELS; ++ch)
+        _lastChannels[ch] = r.crsf->getChannelRaw(ch + 1);
+    _selected = idx;
+    ++r.forwarded;
+    return true;
+}
+
+// A copy carries the same channels. So does a new packet when the sticks didn't move, dropping
+// that one within the window loses nothing, the selected receiver brings it a moment later.
+bool CrsfDiversity::isLastPacket(const CrsfSerial &crsf) const
+{
+    for (uint8_t ch = 0; ch < CRSF_NUM_CHANNELS; ++ch)
+        if (crsf.getChannelRaw(ch + 1) != _lastChannels[ch])
+            return false;
+    return true;
+}
+
+uint32_t CrsfDiversity::getWindowUs() const
+{
+    // Past a period the selected receiver should have brought the next packet, a frame with the
+    // same channels is then news of its own. The first interval is good enough, a lost frame in
+    // it only widens the window for a moment.
+    for (uint8_t i = 0; i < _count; ++i)
+        if (_receivers[i].clock.getPeriodUs())
+            return _receivers[i].clock.getPeriodUs();
+    return FrameClock::MAX_PERIOD_US;
+}
+
+bool CrsfDiversity::isAnyLinkUp() const
+{
+    for (uint8_t i = 0; i < _count; ++i)
+        if (_receivers[i].crsf->isLinkUp())
+            return true;
+    return false;
+}
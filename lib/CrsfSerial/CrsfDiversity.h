@@ -0,0 +1,56 @@
+#pragma once
+
+#include "CrsfSerial.h"
+#include <FrameClock.h>
+
+// Merges RC frames from several CRSF receivers that listen to the same transmitter.
+// The newest valid frame wins. A frame with the channels of the last forwarded one that
+// started less than a packet period from it is the same packet seen by another receiver
+// (the time alone can't tell once they are half a period apart): while the output slot
+// (the time until the next USB report goes out) is still open the one with the better
+// uplink LQ wins, once the packet has been reported the late copy is dropped. Every
+// receiver measures the period on its own frames, until one has it the window is the
+// longest period FrameClock follows. Receivers have to be less than a period apart, a
+// copy that comes after the next packet looks like an older packet.
+class CrsfDiversity
+{
+public:
+    static const uint8_t MAX_RECEIVERS = 4;
+    static const uint8_t NO_RECEIVER = 0xFF;
+
+    struct Receiver
+    {
+        CrsfSerial *crsf;
+        uint32_t frames;    // valid RC frames
+        uint32_t forwarded; // frames that made it to the output
+        uint32_t tieWins;   // forwarded over another copy of the same packet on better LQ
+        uint32_t duplicates; // copies of a packet another receiver already delivered
+        FrameClock clock;
+    };
+
+    CrsfDiversity(CrsfSerial *const *receivers, uint8_t count);
+
+    // Receiver idx decoded an RC frame, true if its channels should go to the output
+    bool onFrame(uint8_t idx);
+    // The output slot is consumed, the next frame starts a new one
+    void onReportSent() { _slotOpen = false; }
+
+    bool isAnyLinkUp() const;
+    // Frames of different receivers with the same channels that started closer than this are one packet
+    uint32_t getWindowUs() const;
+    // Receiver of the frame that was forwarded last
+    uint8_t getSelected() const { return _selected; }
+    uint8_t getCount() const { return _count; }
+    const Receiver &getReceiver(uint8_t idx) const { return _receivers[idx]; }
+
+private:
+    Receiver _receivers[MAX_RECEIVERS];
+    uint8_t _count;
+    uint8_t _selected;
+    bool _slotOpen;     // the last forwarded frame has not been reported yet
+    uint32_t _lastStartUs; // first byte of the last forwarded frame
+    uint8_t _lastLq;
+    uint16_t _lastChannels[CRSF_NUM_CHANNELS];
+
+    bool isLastPacket(const CrsfSerial &crsf) const;
+};
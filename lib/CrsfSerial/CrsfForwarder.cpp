@@ -0,0 +1,42 @@
+#include "CrsfForwarder.h"
+
+void CrsfForwarder::resetStats()
+{
+    _frames = 0;
+    _bytes = 0;
+    _drops = 0;
+    _flushes = 0;
+}
+
+void CrsfForwarder::onFrame(const uint8_t *frame, uint8_t len, uint32_t us)
+{
+    if (_mode == FORWARD_OFF)
+        return;
+
+    uint8_t need = _mode == FORWARD_TIMESTAMPED ? len + 4 : len;
+    // Half a frame would throw the host's parser off, only whole ones go out
+    if (_usb.availableForWrite() < need)
+    {
+        ++_drops;
+        return;
+    }
+
+    if (_mode == FORWARD_TIMESTAMPED)
+    {
+        uint8_t stamp[4] = {(uint8_t)us, (uint8_t)(us >> 8), (uint8_t)(us >> 16), (uint8_t)(us >> 24)};
+        _usb.write(stamp, sizeof(stamp));
+    }
+    _usb.write(frame, len);
+    ++_frames;
+    _bytes += need;
+    _unsent = true;
+}
+
+void CrsfForwarder::flush()
+{
+    if (!_unsent)
+        return;
+    _unsent = false;
+    ++_flushes;
+    _usb.send_now();
+}
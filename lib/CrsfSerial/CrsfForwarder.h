@@ -0,0 +1,50 @@
+#pragma once
+
+#include "CrsfSerial.h"
+
+// Raw CRSF over USB serial for PC software that speaks CRSF itself.
+// Every frame that passed its CRC is written to USB as it was received, straight from the
+// parser's receive ring, so the host gets the full 11-bit channels at the receiver's rate
+// instead of HID axes polled every millisecond. Frames read in one loop() pass share USB
+// packets, flush() sends them off at the end of the pass instead of waiting for the USB
+// stack's timeout. A frame that doesn't fit in the USB buffer is dropped whole.
+//
+// FORWARD_TIMESTAMPED puts the arrival of the frame's first byte (micros(), 4 bytes little
+// endian) in front of every frame.
+class CrsfForwarder
+{
+public:
+    enum eForwardMode
+    {
+        FORWARD_OFF,
+        FORWARD_RAW,
+        FORWARD_TIMESTAMPED,
+        FORWARD_MODES
+    };
+
+    CrsfForwarder(HalUsb &usb) : _usb(usb), _mode(FORWARD_OFF), _unsent(false) { resetStats(); }
+
+    uint8_t getMode() const { return _mode; }
+    void setMode(uint8_t mode) { _mode = mode < FORWARD_MODES ? mode : (uint8_t)FORWARD_OFF; }
+    bool active() const { return _mode != FORWARD_OFF; }
+
+    // A valid frame from address to CRC, call from CrsfHandler::onFrame()
+    void onFrame(const uint8_t *frame, uint8_t len, uint32_t us);
+    // End of a receive pass, sends what was written since the last flush
+    void flush();
+
+    uint32_t getFrames() const { return _frames; }
+    uint32_t getBytes() const { return _bytes; }
+    uint32_t getDrops() const { return _drops; }
+    uint32_t getFlushes() const { return _flushes; }
+    void resetStats();
+
+private:
+    HalUsb &_usb;
+    uint8_t _mode;
+    bool _unsent;
+    uint32_t _frames;
+    uint32_t _bytes;
+    uint32_t _drops;
+    uint32_t _flushes;
+};
@@ -0,0 +1,45 @@
+#include "CrsfLinkMonitor.h"
+
+const char *const CrsfLinkMonitor::FIELD_NAMES[LINK_FIELDS] = {"RSSI1", "RSSI2", "LQ", "SNR", "TXPWR", "dRSSI", "dLQ", "dSNR"};
+
+void CrsfLinkMonitor::onLinkStatistics(const crsfLinkStatistics_t *link, uint32_t nowMs)
+{
+    _fields[LINK_RSSI_1].add(link->uplink_RSSI_1, nowMs);
+    _fields[LINK_RSSI_2].add(link->uplink_RSSI_2, nowMs);
+    _fields[LINK_LQ].add(link->uplink_Link_quality, nowMs);
+    _fields[LINK_SNR].add(link->uplink_SNR, nowMs);
+    _fields[LINK_TX_POWER].add(link->uplink_TX_Power, nowMs);
+    _fields[LINK_DOWN_RSSI].add(link->downlink_RSSI, nowMs);
+    _fields[LINK_DOWN_LQ].add(link->downlink_Link_quality, nowMs);
+    _fields[LINK_DOWN_SNR].add(link->downlink_SNR, nowMs);
+}
+
+void CrsfLinkMonitor::onRcFrame(uint32_t nowMs)
+{
+    update(nowMs);
+    ++_rateFrames;
+}
+
+void CrsfLinkMonitor::update(uint32_t nowMs)
+{
+    if (nowMs - _rateStartMs < RATE_SAMPLE_MS)
+        return;
+
+    // A long gap without calls only ever had zero frames
+    if (nowMs - _rateStartMs >= 2 * RATE_SAMPLE_MS)
+        _rateFrames = 0;
+    _rate.add(_rateFrames * (1000 / RATE_SAMPLE_MS), nowMs);
+    _rateFrames = 0;
+    _rateStartMs = nowMs - (nowMs - _rateStartMs) % RATE_SAMPLE_MS;
+    for (uint8_t i = 0; i < LINK_FIELDS; ++i)
+        _fields[i].roll(nowMs);
+}
+
+void CrsfLinkMonitor::reset(uint32_t nowMs)
+{
+    for (uint8_t i = 0; i < LINK_FIELDS; ++i)
+        _fields[i].reset(nowMs);
+    _rate.reset(nowMs);
+    _rateStartMs = nowMs;
+    _rateFrames = 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <RollingWindow.h>
+#include "crsf_protocol.h"
+
+// Rolling min/mean/max of the link statistics and of the RC packet rate of one receiver,
+// over the last RollingWindow::BLOCKS seconds.
+class CrsfLinkMonitor
+{
+public:
+    enum eLinkField
+    {
+        LINK_RSSI_1,
+        LINK_RSSI_2,
+        LINK_LQ,
+        LINK_SNR,
+        LINK_TX_POWER,
+        LINK_DOWN_RSSI,
+        LINK_DOWN_LQ,
+        LINK_DOWN_SNR,
+        LINK_FIELDS
+    };
+    static const char *const FIELD_NAMES[LINK_FIELDS];
+    // The packet rate is sampled over this many ms
+    static const uint16_t RATE_SAMPLE_MS = 100;
+
+    CrsfLinkMonitor() : _rateStartMs(0), _rateFrames(0) {}
+
+    void onLinkStatistics(const crsfLinkStatistics_t *link, uint32_t nowMs);
+    void onRcFrame(uint32_t nowMs);
+    // Call from the main loop, closes rate samples (also the empty ones of an outage)
+    void update(uint32_t nowMs);
+    void reset(uint32_t nowMs);
+
+    const RollingWindow &getField(uint8_t field) const { return _fields[field]; }
+    // Packets per second
+    const RollingWindow &getRate() const { return _rate; }
+
+private:
+    RollingWindow _fields[LINK_FIELDS];
+    RollingWindow _rate;
+    uint32_t _rateStartMs;
+    uint16_t _rateFrames;
+};
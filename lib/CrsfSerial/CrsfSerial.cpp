@@ -30,181 +30,91 @@
 //     }
 // }
 
-CrsfSerial::CrsfSerial(HardwareSerial &port, uint32_t baud) :
-    _port(port), _crc(0xd5), _baud(baud),
-    _lastReceive(0), _lastChannelsPacket(0), _linkIsUp(false),
+// Frame types that have their own handler method, add a line here and a case in processPacketIn()
+static constexpr CrsfFrameRoute frameRoutes[] = {
+    {CRSF_FRAMETYPE_RC_CHANNELS_PACKED, CRSF_EVENT_CHANNELS, CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE},
+    {CRSF_FRAMETYPE_LINK_STATISTICS, CRSF_EVENT_LINK_STATISTICS, CRSF_FRAME_LINK_STATISTICS_PAYLOAD_SIZE},
+    {CRSF_FRAMETYPE_DEVICE_PING, CRSF_EVENT_DEVICE_PING, 2},         // dest, origin
+    {CRSF_FRAMETYPE_PARAMETER_READ, CRSF_EVENT_PARAMETER_READ, 4},   // dest, origin, index, chunk
+    {CRSF_FRAMETYPE_PARAMETER_WRITE, CRSF_EVENT_PARAMETER_WRITE, 4}, // dest, origin, index, value
+    {CRSF_FRAMETYPE_COMMAND, CRSF_EVENT_COMMAND, 4},                 // dest, origin, command, subcommand
+};
+
+constexpr CrsfDispatchTable crsfDispatchTable(frameRoutes);
+
+CrsfSerial::CrsfSerial(HalUart &port, uint32_t baud) :
+    _port(port), _capture(NULL), _captureSource(CAPTURE_SOURCE_CRSF), _rxHead(0), _rxCount(0), _rxCrc(0), _rxCrcPos(2),
+    _lastRxUs(0), _idleUs(0), _frameStartUs(0), _frameValidUs(0), _channelsUs(0), _txHead(0), _txTail(0), _txDrops(0),
+    _baud(baud), _autoBaud(baud == BAUD_AUTO), _lastChannelsPacket(0), _linkIsUp(false),
     _passthroughMode(false)
 {
-    // Crsf serial is 420000 baud for V2
-    _port.begin(_baud);
-}
-
-// Call from main loop to update
-void CrsfSerial::loop()
-{
-    handleSerialIn();
-}
-
-void CrsfSerial::handleSerialIn()
-{
-    while (_port.available())
+    resetStats();
+    // Crsf serial is 420000 baud for V2, so that is where the search starts
+    if (_autoBaud)
     {
-        uint8_t b = _port.read();
-        _lastReceive = millis();
-
-        if (_passthroughMode)
-        {
-            if (onShiftyByte)
-                onShiftyByte(b);
-            continue;
-        }
-
-        _rxBuf[_rxBufPos++] = b;
-        handleByteReceived();
-
-        if (_rxBufPos == (sizeof(_rxBuf)/sizeof(_rxBuf[0])))
-        {
-            // Packet buffer filled and no valid packet found, dump the whole thing
-            _rxBufPos = 0;
-        }
+        _probe.begin(CRSF_BAUDRATE, millis());
+        _baud = _probe.getBaud();
     }
-
-    checkPacketTimeout();
-    checkLinkDown();
-}
-
-void CrsfSerial::handleByteReceived()
-{
-    bool reprocess;
-    do
-    {
-        reprocess = false;
-        if (_rxBufPos > 1)
-        {
-            uint8_t len = _rxBuf[1];
-            // Sanity check the declared length, can't be shorter than Type, X, CRC
-            if (len < 3 || len > CRSF_MAX_PACKET_LEN)
-            {
-                shiftRxBuffer(1);
-                reprocess = true;
-            }
-
-            else if (_rxBufPos >= (len + 2))
-            {
-                uint8_t inCrc = _rxBuf[2 + len - 1];
-                uint8_t crc = _crc.calc(&_rxBuf[2], len - 1);
-                if (crc == inCrc)
-                {
-                    processPacketIn(len);
-                    shiftRxBuffer(len + 2);
-                    reprocess = true;
-                }
-                else
-                {
-                    shiftRxBuffer(1);
-                    reprocess = true;
-                }
-            }  // if complete packet
-        } // if pos > 1
-    } while (reprocess);
-}
-
-void CrsfSerial::checkPacketTimeout()
-{
-    // If we haven't received data in a long time, flush the buffer a byte at a time (to trigger shiftyByte)
-    if (_rxBufPos > 0 && millis() - _lastReceive > CRSF_PACKET_TIMEOUT_MS)
-        while (_rxBufPos)
-            shiftRxBuffer(1);
+    _port.begin(_baud);
+    updateByteTime();
 }
 
-void CrsfSerial::checkLinkDown()
+void CrsfSerial::updateByteTime()
 {
-    if (_linkIsUp && millis() - _lastChannelsPacket > CRSF_FAILSAFE_STAGE1_MS)
-    {
-        if (onLinkDown)
-            onLinkDown();
-        _linkIsUp = false;
-    }
+    // 8N1, ten bits a byte
+    _byteUsQ8 = (10000000ULL << 8) / _baud;
+    _idleGapUs = IDLE_GAP_BYTES * 10000000UL / _baud;
 }
 
-void CrsfSerial::processPacketIn(uint8_t len)
+void CrsfSerial::handleSerialOut()
 {
-    const crsf_header_t *hdr = (crsf_header_t *)_rxBuf;
-    if (hdr->device_addr == CRSF_ADDRESS_FLIGHT_CONTROLLER)
+    while (_txHead != _txTail)
     {
-        switch (hdr->type)
-        {
-        case CRSF_FRAMETYPE_RC_CHANNELS_PACKED:
-            packetChannelsPacked(hdr);
+        int room = _port.availableForWrite();
+        if (room <= 0)
             break;
-        case CRSF_FRAMETYPE_LINK_STATISTICS:
-            packetLinkStatistics(hdr);
-            break;
-        }
-    } // CRSF_ADDRESS_FLIGHT_CONTROLLER
+
+        uint8_t chunk = (_txHead > _txTail ? _txHead : TX_RING_SIZE) - _txTail;
+        if (chunk > room)
+            chunk = room;
+        _port.write(&_txRing[_txTail], chunk);
+        _txTail = (_txTail + chunk) & TX_RING_MASK;
+    }
 }
 
-// Shift the bytes in the RxBuf down by cnt bytes
-void CrsfSerial::shiftRxBuffer(uint8_t cnt)
+void CrsfSerial::checkBaud()
 {
-    // If removing the whole thing, just set pos to 0
-    if (cnt >= _rxBufPos)
-    {
-        _rxBufPos = 0;
+    uint32_t baud = _probe.poll(millis());
+    if (baud == 0)
         return;
-    }
 
-    if (cnt == 1 && onShiftyByte)
-        onShiftyByte(_rxBuf[0]);
-
-    // Otherwise do the slow shift down
-    uint8_t *src = &_rxBuf[cnt];
-    uint8_t *dst = &_rxBuf[0];
-    _rxBufPos -= cnt;
-    uint8_t left = _rxBufPos;
-    while (left--)
-        *dst++ = *src++;
+    _baud = baud;
+    _port.begin(_baud);
+    updateByteTime();
+    // Whatever is buffered was received at the old rate
+    _rxCount = 0;
+    _rxCrc = 0;
+    _rxCrcPos = 2;
 }
 
-void CrsfSerial::packetChannelsPacked(const crsf_header_t *p)
+bool CrsfSerial::packetChannelsPacked(const crsf_header_t *p)
 {
-    crsf_channels_t *ch = (crsf_channels_t *)&p->data;
-    _channels[0] = ch->ch0;
-    _channels[1] = ch->ch1;
-    _channels[2] = ch->ch2;
-    _channels[3] = ch->ch3;
-    _channels[4] = ch->ch4;
-    _channels[5] = ch->ch5;
-    _channels[6] = ch->ch6;
-    _channels[7] = ch->ch7;
-    _channels[8] = ch->ch8;
-    _channels[9] = ch->ch9;
-    _channels[10] = ch->ch10;
-    _channels[11] = ch->ch11;
-    _channels[12] = ch->ch12;
-    _channels[13] = ch->ch13;
-    _channels[14] = ch->ch14;
-    _channels[15] = ch->ch15;
-
-    for (unsigned int i=0; i<CRSF_NUM_CHANNELS; ++i)
-        _channels[i] = map(_channels[i], CRSF_CHANNEL_VALUE_1000, CRSF_CHANNEL_VALUE_2000, 1000, 2000);
-
-    if (!_linkIsUp && onLinkUp)
-        onLinkUp();
+    // Kept raw, conversion to us is a table lookup in getChannel()
+    crsfUnpackChannels(p->data, _channels);
+    _channelsUs = _frameStartUs;
+
+    bool wasUp = _linkIsUp;
     _linkIsUp = true;
+    if (!wasUp)
+        ++_stats.linkUps;
     _lastChannelsPacket = millis();
-
-    if (onPacketChannels)
-        onPacketChannels();
+    return !wasUp;
 }
 
 void CrsfSerial::packetLinkStatistics(const crsf_header_t *p)
 {
     const crsfLinkStatistics_t *link = (crsfLinkStatistics_t *)p->data;
     memcpy(&_linkStatistics, link, sizeof(_linkStatistics));
-
-    if (onPacketLinkStatistics)
-        onPacketLinkStatistics(&_linkStatistics);
 }
 
 void CrsfSerial::write(uint8_t b)
@@ -217,31 +127,42 @@ void CrsfSerial::write(const uint8_t *buf, size_t len)
     _port.write(buf, len);
 }
 
-void CrsfSerial::queuePacket(uint8_t addr, uint8_t type, const void *payload, uint8_t len)
+bool CrsfSerial::queuePacket(uint8_t addr, uint8_t type, const void *payload, uint8_t len)
 {
     if (!_linkIsUp)
-        return;
+        return false;
     if (_passthroughMode)
-        return;
+        return false;
     if (len > CRSF_MAX_PACKET_LEN)
-        return;
+        return false;
+
+    // Keep one slot free to tell a full ring from an empty one
+    if (TX_RING_SIZE - 1 - getTxQueueDepth() < len + 4)
+    {
+        ++_txDrops;
+        return false;
+    }
 
     uint8_t buf[CRSF_MAX_PACKET_LEN+4];
     buf[0] = addr;
     buf[1] = len + 2; // type + payload + crc
     buf[2] = type;
     memcpy(&buf[3], payload, len);
-    buf[len+3] = _crc.calc(&buf[2], len + 1);
+    buf[len+3] = CrsfCrc8::calc(&buf[2], len + 1);
 
-    // Busywait until the serial port seems free
-    //while (millis() - _lastReceive < 2)
-    //    loop();
-    write(buf, len + 4);
+    for (uint8_t i = 0; i < len + 4; ++i)
+    {
+        _txRing[_txHead] = buf[i];
+        _txHead = (_txHead + 1) & TX_RING_MASK;
+    }
+    return true;
 }
 
 void CrsfSerial::setPassthroughMode(bool val, unsigned int baud)
 {
     _passthroughMode = val;
+    // Queued telemetry is meaningless to whatever is on the other side now
+    _txTail = _txHead;
     _port.flush();
     if (baud != 0)
         _port.begin(baud);
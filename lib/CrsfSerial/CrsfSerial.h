@@ -1,60 +1,458 @@
 #pragma once
 
-#include <Arduino.h>
-#include <functional>
-#include <crc8.h>
+#include <Hal.h>
+#include "CrsfCrc8.h"
+#include <InputCapture.h>
 #include "crsf_protocol.h"
+#include "CrsfChannels.h"
+#include "CrsfBaudProbe.h"
 
 enum eFailsafeAction { fsaNoPulses, fsaHold };
 
+class CrsfSerial;
+
+// Event handlers for CrsfSerial::loop(), bound at compile time: derive from CrsfHandler and
+// hide the methods you need. Calls are resolved on the handler's own type, so they inline
+// into the parser and the empty defaults compile away.
+struct CrsfHandler
+{
+    void onLinkUp(CrsfSerial &) {}
+    void onLinkDown(CrsfSerial &) {}
+    // Bytes that are not part of any frame
+    void onShiftyByte(CrsfSerial &, uint8_t) {}
+    void onPacketChannels(CrsfSerial &) {}
+    void onPacketLinkStatistics(CrsfSerial &, const crsfLinkStatistics_t *) {}
+    // Extended frames, payloadLen counts from dest_addr
+    void onDevicePing(CrsfSerial &, const crsf_ext_header_t *) {}
+    void onParameterRead(CrsfSerial &, const crsf_ext_header_t *, uint8_t) {}
+    void onParameterWrite(CrsfSerial &, const crsf_ext_header_t *, uint8_t) {}
+    void onCommand(CrsfSerial &, const crsf_ext_header_t *, uint8_t) {}
+    // Any other valid frame, whatever its address
+    void onPacket(CrsfSerial &, const crsf_header_t *, uint8_t) {}
+    // Every frame that passed its CRC before it is dispatched, address to CRC as received.
+    // Points into the receive ring, only valid during the call.
+    void onFrame(CrsfSerial &, const uint8_t *, uint8_t) {}
+};
+
+// What processPacketIn() does with a frame type
+enum eCrsfEvent
+{
+    CRSF_EVENT_NONE, // onPacket()
+    CRSF_EVENT_CHANNELS,
+    CRSF_EVENT_LINK_STATISTICS,
+    CRSF_EVENT_DEVICE_PING,
+    CRSF_EVENT_PARAMETER_READ,
+    CRSF_EVENT_PARAMETER_WRITE,
+    CRSF_EVENT_COMMAND,
+    CRSF_EVENT_COUNT
+};
+
+// Parser health, counts only go up until resetStats()
+struct CrsfParserStats
+{
+    uint32_t frames[CRSF_EVENT_COUNT]; // valid frames by eCrsfEvent, CRSF_EVENT_NONE is all other types
+    uint32_t crcErrors;
+    uint32_t lengthErrors; // declared length out of range or payload too short for the type
+    uint32_t resyncBytes;  // bytes skipped looking for the next frame start
+    uint32_t timeouts;     // partial frame flushed after CRSF_PACKET_TIMEOUT_MS of silence
+    uint32_t gapDrops;     // partial frame dropped because the line went idle in the middle of it
+    uint32_t linkUps;
+    uint32_t linkDowns;
+};
+
+// One line of the frame type to handler routing in CrsfSerial.cpp
+struct CrsfFrameRoute
+{
+    uint8_t type;
+    uint8_t event;      // eCrsfEvent
+    uint8_t minPayload; // shorter frames are dropped before the handler sees them
+};
+
+// Routes spread over all 256 frame types, so dispatch is one lookup and a dense switch
+struct CrsfDispatchTable
+{
+    uint8_t event[256];
+    uint8_t minPayload[256];
+
+    template <size_t N>
+    constexpr CrsfDispatchTable(const CrsfFrameRoute (&routes)[N]) : event(), minPayload()
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            event[routes[i].type] = routes[i].event;
+            minPayload[routes[i].type] = routes[i].minPayload;
+        }
+    }
+};
+
+extern const CrsfDispatchTable crsfDispatchTable;
+
+// Parser state and everything that doesn't read the UART. The handlers get this, the loop
+// lives in CrsfSerialPort, which knows the UART's class.
 class CrsfSerial
 {
 public:
     // Packet timeout where buffer is flushed if no data is received in this time
     static const unsigned int CRSF_PACKET_TIMEOUT_MS = 100;
     static const unsigned int CRSF_FAILSAFE_STAGE1_MS = 300;
+    // Pass as baud to find the receiver's rate from the frames that pass their CRC, see CrsfBaudProbe
+    static const uint32_t BAUD_AUTO = 0;
+    // Silence on the line that ends a frame, in byte times. Frames are sent back to back so they
+    // never contain one, more than the UART FIFO (8 bytes on the Teensy 3) can hold back.
+    static const uint8_t IDLE_GAP_BYTES = 8;
 
-    CrsfSerial(HardwareSerial &port, uint32_t baud = CRSF_BAUDRATE);
-    void loop();
     void write(uint8_t b);
     void write(const uint8_t *buf, size_t len);
-    void queuePacket(uint8_t addr, uint8_t type, const void *payload, uint8_t len);
+    // Queue a frame for the non-blocking transmit ring, false if it was dropped
+    bool queuePacket(uint8_t addr, uint8_t type, const void *payload, uint8_t len);
+    uint8_t getTxQueueDepth() const { return (_txHead - _txTail) & TX_RING_MASK; }
+    uint32_t getTxDrops() const { return _txDrops; }
 
     // Return current channel value (1-based) in us
-    int getChannel(unsigned int ch) const { return _channels[ch - 1]; }
+    int getChannel(unsigned int ch) const { return crsfChannelToUs(_channels[ch - 1]); }
+    // Return current channel value (1-based) as received, 11-bit
+    uint16_t getChannelRaw(unsigned int ch) const { return _channels[ch - 1]; }
     const crsfLinkStatistics_t *getLinkStatistics() const { return &_linkStatistics; }
     bool isLinkUp() const { return _linkIsUp; }
+    // When the first byte of the frame being dispatched arrived (estimated from the bytes read
+    // with it and the byte time) and micros() when its CRC checked out, valid inside the packet handlers
+    uint32_t getFrameStartUs() const { return _frameStartUs; }
+    uint32_t getFrameValidUs() const { return _frameValidUs; }
+    // Arrival of the frame the current channel values came from
+    uint32_t getChannelsUs() const { return _channelsUs; }
+    uint32_t getIdleGapUs() const { return _idleGapUs; }
     bool getPassthroughMode() const { return _passthroughMode; }
+    // In passthrough the UART is left alone for whoever moves the bytes, see SerialBridge
     void setPassthroughMode(bool val, unsigned int baud = 0);
+    HalUart &getPort() { return _port; }
+    // Rate the UART runs at, with BAUD_AUTO the one being tried or locked
+    uint32_t getBaud() const { return _baud; }
+    bool isAutoBaud() const { return _autoBaud; }
+    const CrsfBaudProbe &getBaudProbe() const { return _probe; }
+    const CrsfParserStats &getStats() const { return _stats; }
+    void resetStats() { memset(&_stats, 0, sizeof(_stats)); }
+    // Record every received byte (outside passthrough) into capture, NULL to stop
+    void setCapture(InputCapture *capture, uint8_t source = CAPTURE_SOURCE_CRSF)
+    {
+        _capture = capture;
+        _captureSource = source;
+    }
 
-    // Event Handlers
-    std::function<void()> onLinkUp;
-    std::function<void()> onLinkDown;
-    std::function<void(uint8_t)> onShiftyByte;
-    std::function<void()> onPacketChannels;
-    std::function<void(crsfLinkStatistics_t *)> onPacketLinkStatistics;
+protected:
+    CrsfSerial(HalUart &port, uint32_t baud);
+
+    template <class Port, class Handler>
+    void handleSerialIn(Port &port, Handler &handler);
+    void handleSerialOut();
 
 private:
-    HardwareSerial &_port;
-    uint8_t _rxBuf[CRSF_MAX_PACKET_LEN+3];
-    uint8_t _rxBufPos;
-    Crc8 _crc;
+    // Receive ring, every byte is stored twice (at pos and pos + RX_RING_SIZE)
+    // so a frame starting anywhere in the ring can be decoded where it sits
+    static const uint8_t RX_RING_SIZE = 128; // power of 2
+    static const uint8_t RX_RING_MASK = RX_RING_SIZE - 1;
+    // A candidate frame is taken or dropped as soon as its declared length is in, so it never fills up
+    static_assert(RX_RING_SIZE > CRSF_MAX_PACKET_LEN + 2, "receive ring must hold the longest frame");
+    // Transmit ring drained into the UART only as fast as it accepts without blocking
+    static const uint8_t TX_RING_SIZE = 128; // power of 2
+    static const uint8_t TX_RING_MASK = TX_RING_SIZE - 1;
+
+    HalUart &_port;
+    InputCapture *_capture;
+    uint8_t _captureSource;
+    uint8_t _rxRing[RX_RING_SIZE * 2];
+    uint8_t _rxHead;  // start of the candidate frame
+    uint8_t _rxCount; // bytes buffered from _rxHead
+    uint8_t _rxCrc;    // crc of the candidate frame accumulated so far
+    uint8_t _rxCrcPos; // offset of the next byte to fold into _rxCrc
+    uint32_t _rxTime[RX_RING_SIZE]; // estimated arrival of each byte
+    uint32_t _lastRxUs;   // last bytes were read, they arrived no later than this
+    uint32_t _idleUs;     // last time the UART had nothing
+    uint32_t _byteUsQ8;   // one byte on the wire, 1/256 us
+    uint32_t _idleGapUs;
+    uint32_t _frameStartUs;
+    uint32_t _frameValidUs;
+    uint32_t _channelsUs;
+    uint8_t _txRing[TX_RING_SIZE];
+    uint8_t _txHead;
+    uint8_t _txTail;
+    uint32_t _txDrops;
     crsfLinkStatistics_t _linkStatistics;
     uint32_t _baud;
-    uint32_t _lastReceive;
+    bool _autoBaud;
+    CrsfBaudProbe _probe;
     uint32_t _lastChannelsPacket;
     bool _linkIsUp;
     bool _passthroughMode;
-    int _channels[CRSF_NUM_CHANNELS];
+    uint16_t _channels[CRSF_NUM_CHANNELS];
+    CrsfParserStats _stats;
 
-    void handleSerialIn();
-    void handleByteReceived();
-    void shiftRxBuffer(uint8_t cnt);
-    void processPacketIn(uint8_t len);
-    void checkPacketTimeout();
-    void checkLinkDown();
+    // Candidate first bytes of a frame, anything else can never start one
+    static bool isFrameStart(uint8_t b)
+    {
+        return b == CRSF_ADDRESS_FLIGHT_CONTROLLER || b == CRSF_ADDRESS_CRSF_RECEIVER ||
+               b == CRSF_ADDRESS_CRSF_TRANSMITTER || b == CRSF_ADDRESS_RADIO_TRANSMITTER;
+    }
 
-    // Packet Handlers
-    void packetChannelsPacked(const crsf_header_t *p);
+    void checkBaud();
+    void updateByteTime();
+    template <class Handler>
+    void handleByteReceived(Handler &handler);
+    void pushRxByte(uint8_t b, uint32_t us);
+    template <class Handler>
+    void discardRx(Handler &handler, uint8_t cnt);
+    template <class Handler>
+    void resyncRx(Handler &handler);
+    // Fold what arrived of the candidate frame into the crc, true once the whole frame is in
+    bool updateRxCrc(uint8_t len);
+    template <class Handler>
+    void processPacketIn(Handler &handler, uint8_t len);
+    template <class Handler>
+    void checkPacketTimeout(Handler &handler);
+    template <class Handler>
+    void checkLinkDown(Handler &handler);
+
+    // Packet Handlers, update the state, true if the link just came up
+    bool packetChannelsPacked(const crsf_header_t *p);
     void packetLinkStatistics(const crsf_header_t *p);
-};
\ No newline at end of file
+};
+
+// CrsfSerial on a UART of class Port (HalUart1..3), so the byte loop reads it without the vtable
+template <class Port>
+class CrsfSerialPort : public CrsfSerial
+{
+public:
+    CrsfSerialPort(Port &port, uint32_t baud = CRSF_BAUDRATE) : CrsfSerial(port, baud) {}
+
+    // Call from main loop to update, handler receives the events
+    template <class Handler>
+    void loop(Handler &handler)
+    {
+        handleSerialIn(static_cast<Port &>(getPort()), handler);
+        handleSerialOut();
+    }
+    void loop()
+    {
+        CrsfHandler none;
+        loop(none);
+    }
+};
+
+// The parser is templated on the handler so the events inline, it lives here for that reason
+
+template <class Port, class Handler>
+void CrsfSerial::handleSerialIn(Port &port, Handler &handler)
+{
+    if (_passthroughMode)
+        return;
+
+    uint32_t now = micros();
+    int avail = halAvailable(port);
+    if (avail == 0)
+        _idleUs = now;
+    else
+    {
+        // Nothing came in between the last byte and the last time the UART was empty, if that
+        // is longer than a gap whatever frame is buffered ended without its bytes
+        if (_rxCount && (int32_t)(_idleUs - _lastRxUs) >= (int32_t)_idleGapUs)
+        {
+            ++_stats.gapDrops;
+            discardRx(handler, _rxCount);
+        }
+
+        // The bytes came in back to back up to now, but not before the UART was last seen empty
+        // or the previous bytes were read
+        uint32_t floorUs = (int32_t)(_idleUs - _lastRxUs) > 0 ? _idleUs : _lastRxUs;
+        for (int i = avail - 1; i >= 0; --i)
+        {
+            uint8_t b = halRead(port);
+            uint32_t us = now - ((i * _byteUsQ8) >> 8);
+            if ((int32_t)(us - floorUs) < 0)
+                us = floorUs;
+
+            if (_capture)
+                _capture->record(_captureSource, now, b);
+
+            // Nothing buffered and this can't start a frame, don't even queue it
+            if (_rxCount == 0 && !isFrameStart(b))
+            {
+                ++_stats.resyncBytes;
+                handler.onShiftyByte(*this, b);
+                continue;
+            }
+
+            pushRxByte(b, us);
+            handleByteReceived(handler);
+        }
+        _lastRxUs = now;
+    }
+
+    checkPacketTimeout(handler);
+    checkLinkDown(handler);
+    if (_autoBaud)
+        checkBaud();
+}
+
+// Append a byte to the ring, writing both halves of the mirror
+inline void CrsfSerial::pushRxByte(uint8_t b, uint32_t us)
+{
+    uint8_t pos = (_rxHead + _rxCount) & RX_RING_MASK;
+    _rxRing[pos] = b;
+    _rxRing[pos + RX_RING_SIZE] = b;
+    _rxTime[pos] = us;
+    ++_rxCount;
+}
+
+inline bool CrsfSerial::updateRxCrc(uint8_t len)
+{
+    // Fold whatever arrived of Type + Payload into the crc, so it is ready
+    // the moment the last byte lands (catches up in bulk after a resync)
+    const uint8_t *frame = &_rxRing[_rxHead];
+    uint8_t crcEnd = (_rxCount < len + 1) ? _rxCount : len + 1;
+    if (_rxCrcPos + 1 == crcEnd)
+        _rxCrc = CrsfCrc8::update(_rxCrc, frame[_rxCrcPos++]);
+    else if (_rxCrcPos < crcEnd)
+    {
+        _rxCrc = CrsfCrc8::calc(&frame[_rxCrcPos], crcEnd - _rxCrcPos, _rxCrc);
+        _rxCrcPos = crcEnd;
+    }
+
+    return _rxCount >= len + 2;
+}
+
+template <class Handler>
+void CrsfSerial::handleByteReceived(Handler &handler)
+{
+    while (_rxCount > 1)
+    {
+        const uint8_t *frame = &_rxRing[_rxHead];
+        uint8_t len = frame[1];
+        // Sanity check the declared length, can't be shorter than Type, X, CRC
+        if (len < 3 || len > CRSF_MAX_PACKET_LEN)
+        {
+            ++_stats.lengthErrors;
+            resyncRx(handler);
+            continue;
+        }
+
+        // Wait for the rest of the packet
+        if (!updateRxCrc(len))
+            break;
+
+        uint8_t inCrc = frame[2 + len - 1];
+        if (_rxCrc == inCrc)
+        {
+            if (_autoBaud)
+                _probe.onValidFrame(millis());
+            _frameStartUs = _rxTime[_rxHead];
+            _frameValidUs = micros();
+            handler.onFrame(*this, frame, len + 2);
+            processPacketIn(handler, len);
+            _rxHead = (_rxHead + len + 2) & RX_RING_MASK;
+            _rxCount -= len + 2;
+            _rxCrc = 0;
+            _rxCrcPos = 2;
+            // Whatever follows the packet must start a new one
+            if (_rxCount && !isFrameStart(_rxRing[_rxHead]))
+                resyncRx(handler);
+        }
+        else
+        {
+            ++_stats.crcErrors;
+            resyncRx(handler);
+        }
+    }
+}
+
+template <class Handler>
+void CrsfSerial::checkPacketTimeout(Handler &handler)
+{
+    // If we haven't received data in a long time, flush the buffer (to trigger shiftyByte)
+    if (_rxCount > 0 && micros() - _lastRxUs > CRSF_PACKET_TIMEOUT_MS * 1000)
+    {
+        ++_stats.timeouts;
+        discardRx(handler, _rxCount);
+    }
+}
+
+template <class Handler>
+void CrsfSerial::checkLinkDown(Handler &handler)
+{
+    if (_linkIsUp && millis() - _lastChannelsPacket > CRSF_FAILSAFE_STAGE1_MS)
+    {
+        // Updated first so isLinkUp() is already right inside the handler
+        _linkIsUp = false;
+        ++_stats.linkDowns;
+        handler.onLinkDown(*this);
+    }
+}
+
+template <class Handler>
+void CrsfSerial::processPacketIn(Handler &handler, uint8_t len)
+{
+    const crsf_header_t *hdr = (crsf_header_t *)&_rxRing[_rxHead];
+    const crsf_ext_header_t *ext = (crsf_ext_header_t *)hdr;
+    uint8_t payloadLen = len - 2;
+    uint8_t event = crsfDispatchTable.event[hdr->type];
+    if (payloadLen < crsfDispatchTable.minPayload[hdr->type])
+    {
+        ++_stats.lengthErrors;
+        return;
+    }
+    ++_stats.frames[event];
+
+    // Only frames for the flight controller reach the handlers, apart from onPacket()
+    if (event != CRSF_EVENT_NONE && hdr->device_addr != CRSF_ADDRESS_FLIGHT_CONTROLLER)
+        return;
+
+    switch (event)
+    {
+    case CRSF_EVENT_CHANNELS:
+        if (packetChannelsPacked(hdr))
+            handler.onLinkUp(*this);
+        handler.onPacketChannels(*this);
+        break;
+    case CRSF_EVENT_LINK_STATISTICS:
+        packetLinkStatistics(hdr);
+        handler.onPacketLinkStatistics(*this, &_linkStatistics);
+        break;
+    case CRSF_EVENT_DEVICE_PING:
+        handler.onDevicePing(*this, ext);
+        break;
+    case CRSF_EVENT_PARAMETER_READ:
+        handler.onParameterRead(*this, ext, payloadLen);
+        break;
+    case CRSF_EVENT_PARAMETER_WRITE:
+        handler.onParameterWrite(*this, ext, payloadLen);
+        break;
+    case CRSF_EVENT_COMMAND:
+        handler.onCommand(*this, ext, payloadLen);
+        break;
+    default:
+        handler.onPacket(*this, hdr, payloadLen);
+        break;
+    }
+}
+
+// Drop cnt bytes from the head of the ring, they are not part of any packet
+template <class Handler>
+void CrsfSerial::discardRx(Handler &handler, uint8_t cnt)
+{
+    for (uint8_t i = 0; i < cnt; ++i)
+        handler.onShiftyByte(*this, _rxRing[_rxHead + i]);
+
+    _rxHead = (_rxHead + cnt) & RX_RING_MASK;
+    _rxCount -= cnt;
+    _rxCrc = 0;
+    _rxCrcPos = 2;
+}
+
+// The head is not a valid packet, skip straight to the next byte that could start one
+template <class Handler>
+void CrsfSerial::resyncRx(Handler &handler)
+{
+    uint8_t skip = 1;
+    while (skip < _rxCount && !isFrameStart(_rxRing[_rxHead + skip]))
+        ++skip;
+    _stats.resyncBytes += skip;
+    discardRx(handler, skip);
+}
@@ -0,0 +1,79 @@
+#include "CrsfTelemetry.h"
+
+CrsfTelemetry::Slot *CrsfTelemetry::find(uint8_t type)
+{
+    for (uint8_t i = 0; i < _slotCount; ++i)
+        if (_slots[i].type == type)
+            return &_slots[i];
+    return NULL;
+}
+
+bool CrsfTelemetry::configure(uint8_t type, uint8_t priority, uint16_t intervalMs)
+{
+    Slot *slot = find(type);
+    if (!slot)
+    {
+        if (_slotCount == MAX_SLOTS)
+            return false;
+        slot = &_slots[_slotCount++];
+        memset(slot, 0, sizeof(*slot));
+        slot->type = type;
+    }
+
+    slot->priority = priority;
+    slot->intervalMs = intervalMs;
+    return true;
+}
+
+bool CrsfTelemetry::setPayload(uint8_t type, const void *payload, uint8_t len)
+{
+    Slot *slot = find(type);
+    if (!slot || len > MAX_PAYLOAD)
+        return false;
+
+    if (slot->fresh)
+        ++slot->coalesced;
+    memcpy(slot->payload, payload, len);
+    slot->len = len;
+    slot->fresh = true;
+    return true;
+}
+
+void CrsfTelemetry::loop()
+{
+    if (!_slotOpen)
+        return;
+    _slotOpen = false;
+
+    // One frame per slot, if the last one is still going out the link is saturated
+    if (_crsf.getTxQueueDepth() != 0)
+    {
+        ++_busy;
+        return;
+    }
+
+    uint32_t now = millis();
+    Slot *best = NULL;
+    for (uint8_t i = 0; i < _slotCount; ++i)
+    {
+        Slot *slot = &_slots[i];
+        if (slot->len == 0 || (slot->sent && now - slot->lastSentMs < slot->intervalMs))
+            continue;
+        if (!best || slot->priority < best->priority ||
+            (slot->priority == best->priority && now - slot->lastSentMs > now - best->lastSentMs))
+            best = slot;
+    }
+
+    if (!best)
+    {
+        ++_idle;
+        return;
+    }
+
+    if (_crsf.queuePacket(CRSF_SYNC_BYTE, best->type, best->payload, best->len))
+    {
+        best->lastSentMs = now;
+        best->fresh = false;
+        ++best->sent;
+    }
+}
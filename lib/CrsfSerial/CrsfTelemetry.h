@@ -0,0 +1,55 @@
+#pragma once
+
+#include "CrsfSerial.h"
+
+// Downlink telemetry scheduler.
+// Each received RC frame opens one transmit slot, so telemetry goes out in the gap
+// after it instead of flooding the link at the packet rate. The slot goes to the most
+// important frame type that is due (priority 0 first, then the longest waiting one),
+// every type is sent at most once per intervalMs and always with its latest payload.
+class CrsfTelemetry
+{
+public:
+    static const uint8_t MAX_SLOTS = 8;
+    static const uint8_t MAX_PAYLOAD = 32;
+
+    struct Slot
+    {
+        uint8_t type;
+        uint8_t priority;
+        uint8_t len;
+        bool fresh;           // payload changed since it was last sent
+        uint16_t intervalMs;
+        uint32_t lastSentMs;
+        uint32_t sent;
+        uint32_t coalesced;   // updates replaced before they were sent
+        uint8_t payload[MAX_PAYLOAD];
+    };
+
+    CrsfTelemetry(CrsfSerial &crsf) : _crsf(crsf), _slotCount(0), _slotOpen(false), _busy(0), _idle(0) {}
+
+    // Register a frame type, false if there is no room left
+    bool configure(uint8_t type, uint8_t priority, uint16_t intervalMs);
+    // Latest value of a frame type, replaces a value that was not sent yet
+    bool setPayload(uint8_t type, const void *payload, uint8_t len);
+    // An RC frame was received, the next loop() may send one frame
+    void onRcFrame() { _slotOpen = true; }
+    // Call from the main loop once the USB report is out
+    void loop();
+
+    uint8_t getSlotCount() const { return _slotCount; }
+    const Slot &getSlot(uint8_t idx) const { return _slots[idx]; }
+    // Transmit slots lost because the previous frame was still queued / nothing was due
+    uint32_t getBusy() const { return _busy; }
+    uint32_t getIdle() const { return _idle; }
+
+private:
+    CrsfSerial &_crsf;
+    Slot _slots[MAX_SLOTS];
+    uint8_t _slotCount;
+    bool _slotOpen;
+    uint32_t _busy;
+    uint32_t _idle;
+
+    Slot *find(uint8_t type);
+};
@@ -0,0 +1,67 @@
+#include "CrsfTelemetryFeed.h"
+
+void CrsfTelemetryFeed::resetStats()
+{
+    _frames = 0;
+    _crcErrors = 0;
+    _rejected = 0;
+    _timeouts = 0;
+}
+
+bool CrsfTelemetryFeed::sizeFits(uint8_t type, uint8_t len)
+{
+    switch (type)
+    {
+    case CRSF_FRAMETYPE_BATTERY_SENSOR:
+        return len == CRSF_FRAME_BATTERY_SENSOR_PAYLOAD_SIZE;
+    case CRSF_FRAMETYPE_GPS:
+        return len == CRSF_FRAME_GPS_PAYLOAD_SIZE;
+    case CRSF_FRAMETYPE_ATTITUDE:
+        return len == CRSF_FRAME_ATTITUDE_PAYLOAD_SIZE;
+    case CRSF_FRAMETYPE_FLIGHT_MODE:
+        // Null terminated string
+        return len > 0;
+    default:
+        return true;
+    }
+}
+
+bool CrsfTelemetryFeed::feed(uint8_t b, uint32_t nowMs)
+{
+    if (_pos && nowMs - _lastMs > TIMEOUT_MS)
+    {
+        ++_timeouts;
+        _pos = 0;
+    }
+    if (_pos == 0 && b != CRSF_SYNC_BYTE)
+        return false;
+
+    _lastMs = nowMs;
+    _buf[_pos++] = b;
+    if (_pos == 2 && (b < 2 || b > CrsfTelemetry::MAX_PAYLOAD + 2))
+    {
+        // Can't be a frame we take, what follows is whatever the host sends next
+        ++_rejected;
+        _pos = 0;
+    }
+    else if (_pos > 2 && _pos == _buf[1] + 2)
+    {
+        dispatch();
+        _pos = 0;
+    }
+    return true;
+}
+
+void CrsfTelemetryFeed::dispatch()
+{
+    uint8_t len = _buf[1] - 2;
+    if (CrsfCrc8::calc(&_buf[2], len + 1) != _buf[len + 3])
+    {
+        ++_crcErrors;
+        return;
+    }
+
+    ++_frames;
+    if (!sizeFits(_buf[2], len) || !_telemetry.setPayload(_buf[2], &_buf[3], len))
+        ++_rejected;
+}
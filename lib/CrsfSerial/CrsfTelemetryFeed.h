@@ -0,0 +1,42 @@
+#pragma once
+
+#include "CrsfTelemetry.h"
+
+// Telemetry from the host (a simulator plugin) over USB serial, so the radio shows the
+// simulated battery, GPS, attitude and flight mode instead of a fixed payload.
+// The host sends plain CRSF frames: CRSF_SYNC_BYTE, length, type, payload, CRC over type and
+// payload, with the payload as it goes out to the receiver (crsf_sensor_battery_t and so on).
+// They share the port with the CLI, 0xC8 never shows up in text so it tells them apart.
+// Bytes are taken one at a time as they arrive, a frame only reaches CrsfTelemetry once its
+// CRC checks out, where a newer value of the same type replaces one that was not sent yet.
+class CrsfTelemetryFeed
+{
+public:
+    // A frame that stops arriving half way is dropped after this
+    static const uint16_t TIMEOUT_MS = 100;
+
+    CrsfTelemetryFeed(CrsfTelemetry &telemetry) : _telemetry(telemetry), _pos(0), _lastMs(0) { resetStats(); }
+
+    // True if b is part of a frame, false if it is CLI text
+    bool feed(uint8_t b, uint32_t nowMs);
+
+    uint32_t getFrames() const { return _frames; }
+    uint32_t getCrcErrors() const { return _crcErrors; }
+    // Valid frames of a type that isn't configured for telemetry, or with the wrong payload size
+    uint32_t getRejected() const { return _rejected; }
+    uint32_t getTimeouts() const { return _timeouts; }
+    void resetStats();
+
+private:
+    CrsfTelemetry &_telemetry;
+    uint8_t _buf[CrsfTelemetry::MAX_PAYLOAD + 4];
+    uint8_t _pos;
+    uint32_t _lastMs;
+    uint32_t _frames;
+    uint32_t _crcErrors;
+    uint32_t _rejected;
+    uint32_t _timeouts;
+
+    void dispatch();
+    static bool sizeFits(uint8_t type, uint8_t len);
+};
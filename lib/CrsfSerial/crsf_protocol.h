@@ -83,6 +83,17 @@ typedef struct crsf_header_s
     uint8_t data[0];
 } PACKED crsf_header_t;
 
+// Extended header frames (type 0x28 and up) carry destination and origin
+typedef struct crsf_ext_header_s
+{
+    uint8_t device_addr;
+    uint8_t frame_size;
+    uint8_t type;
+    uint8_t dest_addr;
+    uint8_t orig_addr;
+    uint8_t data[0];
+} PACKED crsf_ext_header_t;
+
 typedef struct crsf_channels_s
 {
     unsigned ch0 : 11;
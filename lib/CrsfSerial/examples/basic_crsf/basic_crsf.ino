@@ -1,16 +1,20 @@
 #include <CrsfSerial.h>
 
-CrsfSerial crsf(Serial1, CRSF_BAUDRATE); // pass any HardwareSerial port
+CrsfSerialPort<HalUart1> crsf(Serial1, CRSF_BAUDRATE); // any UART, HalUart1..3 is its class
 
 /***
- * This callback is called whenever new channel values are available.
+ * The handler's methods are called from crsf.loop(), only define the events you need.
+ * onPacketChannels() is called whenever new channel values are available.
  * Use crsf.getChannel(x) to get us channel values.
  ***/
-void packetChannels()
+struct Handler : CrsfHandler
 {
-    Serial.print("CH0=");
-    Serial.println(crsf.getChannel(0));
-}
+    void onPacketChannels(CrsfSerial &crsf)
+    {
+        Serial.print("CH1=");
+        Serial.println(crsf.getChannel(1));
+    }
+} handler;
 
 void setup()
 {
@@ -18,13 +22,10 @@ void setup()
 
     // If something other than changing the baud of the UART needs to be done, do it here
     // Serial1.end(); Serial1.begin(500000, SERIAL_8N1, 16, 17);
-
-    // Attach the channels callback
-    crsf.onPacketChannels = &packetChannels;
 }
 
 void loop()
 {
     // Must call CrsfSerial.loop() in loop() to process data
-    crsf.loop();
-}
\ No newline at end of file
+    crsf.loop(handler);
+}
@@ -0,0 +1,78 @@
+#include "FrameClock.h"
+#include <stdlib.h>
+
+void FrameClock::reset()
+{
+    _periodQ4 = 0;
+    _jitterQ4 = 0;
+    _lastUs = 0;
+    _missed = 0;
+    _restarts = 0;
+    _good = 0;
+    _started = false;
+}
+
+void FrameClock::restart(uint32_t us)
+{
+    _periodQ4 = 0;
+    _good = 0;
+    _lastUs = us;
+    ++_restarts;
+}
+
+void FrameClock::onFrame(uint32_t us)
+{
+    if (!_started)
+    {
+        _started = true;
+        _lastUs = us;
+        return;
+    }
+
+    uint32_t dt = us - _lastUs;
+    if (_periodQ4 == 0)
+    {
+        // First interval, taken as it is
+        _lastUs = us;
+        if (dt >= MIN_PERIOD_US && dt <= MAX_PERIOD_US)
+            _periodQ4 = dt << 4;
+        return;
+    }
+
+    // Whole periods since the last frame, more than one means frames got lost
+    uint32_t period = _periodQ4 >> 4;
+    uint32_t k = (dt + period / 2) / period;
+    if (k == 0 || k > MAX_GAP + 1)
+    {
+        restart(us);
+        return;
+    }
+
+    int32_t errQ4 = (int32_t)((dt << 4) - k * _periodQ4);
+    if ((uint32_t)abs(errQ4) > _periodQ4 / 4)
+    {
+        // Too far off to be jitter, keep the period but take this frame's phase
+        _good = 0;
+        _lastUs = us;
+        return;
+    }
+
+    _missed += k - 1;
+    _lastUs = us - (errQ4 * 3 / 4) / 16;
+    _periodQ4 += errQ4 / (int32_t)(8 * k);
+    if (_periodQ4 < MIN_PERIOD_US << 4)
+        _periodQ4 = MIN_PERIOD_US << 4;
+    else if (_periodQ4 > MAX_PERIOD_US << 4)
+        _periodQ4 = MAX_PERIOD_US << 4;
+    _jitterQ4 += ((int32_t)abs(errQ4) - (int32_t)_jitterQ4) / 8;
+    if (_good < LOCK_FRAMES)
+        ++_good;
+}
+
+uint32_t FrameClock::getPhaseQ8(uint32_t nowUs) const
+{
+    int32_t since = (int32_t)(nowUs - _lastUs);
+    if (since <= 0 || _periodQ4 == 0)
+        return 0;
+    return ((uint64_t)since << 12) / _periodQ4;
+}
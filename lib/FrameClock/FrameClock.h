@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+// Online estimate of the period and phase of a frame stream that runs on another clock.
+// Every frame is checked against the prediction from the last one: the error moves the
+// phase by a quarter and the period by an eighth (an alpha-beta filter), so receive jitter
+// is smoothed out while a drifting transmitter clock is followed. Lost frames are counted
+// as whole periods, anything that does not fit the estimate at all starts it over.
+class FrameClock
+{
+public:
+    static const uint32_t MIN_PERIOD_US = 500;   // 2 kHz
+    static const uint32_t MAX_PERIOD_US = 50000; // 20 Hz
+    static const uint8_t MAX_GAP = 8;            // lost frames in a row before starting over
+    static const uint8_t LOCK_FRAMES = 8;        // frames that fit the estimate before it is used
+
+    FrameClock() { reset(); }
+    void reset();
+    // A frame started at us
+    void onFrame(uint32_t us);
+
+    bool isLocked() const { return _good >= LOCK_FRAMES; }
+    uint32_t getPeriodUs() const { return _periodQ4 >> 4; }
+    // Mean deviation of the frames from the prediction
+    uint32_t getJitterUs() const { return _jitterQ4 >> 4; }
+    // Filtered start of the last frame
+    uint32_t getLastUs() const { return _lastUs; }
+    // Time since the last frame started in 1/256 of a period
+    uint32_t getPhaseQ8(uint32_t nowUs) const;
+    uint32_t getMissed() const { return _missed; }
+    uint32_t getRestarts() const { return _restarts; }
+
+private:
+    uint32_t _periodQ4; // 0 until the first interval
+    uint32_t _jitterQ4;
+    uint32_t _lastUs;
+    uint32_t _missed;
+    uint32_t _restarts;
+    uint8_t _good;
+    bool _started;
+
+    void restart(uint32_t us);
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+// Compile time binding of the hardware the CRSF/joystick core talks to.
+//
+// The core only uses these names, so it builds unchanged for the board and the host:
+//  HalUart          receiver UART type (begin/available/read/write/flush), the base of all of them
+//  HalUart1..3      class of Serial1..3, what the byte loops are instantiated on
+//  HalUsb           USB serial type (readBytes/availableForWrite/write/send_now), whatever class
+//                   the USB type makes Serial: usb_seremu_class for the joystick types without serial
+//  Serial           USB serial, Serial1..3 the UARTs
+//  millis/micros    clock
+//  Joystick         USB joystick, usb_joystick_data is its report
+//  digitalWrite/pinMode, map, min
+//
+// The Teensy HardwareSerial methods are virtual. The byte loops take the port's own class
+// and read through halAvailable()/halRead(), which name that class, so they resolve at
+// compile time. Everything else (begin, write, flush) goes through HalUart.
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+
+typedef HardwareSerial HalUart;
+typedef decltype(Serial1) HalUart1;
+typedef decltype(Serial2) HalUart2;
+typedef decltype(Serial3) HalUart3;
+typedef decltype(Serial) HalUsb;
+
+#else
+
+#include "HalNative.h"
+
+#endif
+
+// Calls on Port's own methods, no vtable even through a reference. Port has to be the class
+// of the object (one of HalUart1..3), a base of it would call the base's implementation.
+template <class Port>
+static inline int halAvailable(Port &port) { return port.Port::available(); }
+template <class Port>
+static inline int halRead(Port &port) { return port.Port::read(); }
@@ -0,0 +1,177 @@
+#if !defined(ARDUINO)
+
+#include <stdarg.h>
+#include "HalNative.h"
+
+uint64_t SimClock::_us;
+
+SimSerial Serial;
+SimSerial Serial1;
+SimSerial Serial2;
+SimSerial Serial3;
+SimJoystick Joystick;
+uint32_t usb_joystick_data[(JOYSTICK_SIZE + 3) / 4];
+
+static uint8_t pinState[64];
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin < sizeof(pinState))
+        pinState[pin] = val;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+uint8_t simPinState(uint8_t pin)
+{
+    return pin < sizeof(pinState) ? pinState[pin] : LOW;
+}
+
+int SimSerial::read()
+{
+    if (_rxHead == _rxTail)
+        return -1;
+    return _rx[_rxTail++ % RX_SIZE];
+}
+
+int SimSerial::peek() const
+{
+    if (_rxHead == _rxTail)
+        return -1;
+    return _rx[_rxTail % RX_SIZE];
+}
+
+size_t SimSerial::readBytes(char *buf, size_t len)
+{
+    size_t cnt = 0;
+    while (cnt < len && _rxHead != _rxTail)
+        buf[cnt++] = _rx[_rxTail++ % RX_SIZE];
+    return cnt;
+}
+
+size_t SimSerial::write(uint8_t b)
+{
+    if (_txHead - _txTail == TX_SIZE)
+        return 0;
+    _tx[_txHead++ % TX_SIZE] = b;
+    return 1;
+}
+
+size_t SimSerial::write(const uint8_t *buf, size_t len)
+{
+    size_t cnt = 0;
+    while (cnt < len && write(buf[cnt]))
+        ++cnt;
+    return cnt;
+}
+
+size_t SimSerial::print(long n, int base)
+{
+    if (n < 0)
+        return print('-') + print((unsigned long)-n, base);
+    return print((unsigned long)n, base);
+}
+
+size_t SimSerial::print(unsigned long n, int base)
+{
+    char buf[8 * sizeof(n) + 1];
+    char *p = &buf[sizeof(buf) - 1];
+    *p = '\0';
+    do
+    {
+        uint8_t digit = n % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        n /= base;
+    } while (n);
+    return write(p);
+}
+
+int SimSerial::printf(const char *fmt, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len > 0)
+        write((const uint8_t *)buf, (size_t)len < sizeof(buf) ? len : sizeof(buf) - 1);
+    return len;
+}
+
+size_t SimSerial::inject(const uint8_t *buf, size_t len)
+{
+    size_t cnt = 0;
+    for (; cnt < len; ++cnt)
+    {
+        if (_rxHead - _rxTail == rxCapacity())
+        {
+            _rxOverruns += len - cnt;
+            break;
+        }
+        _rx[_rxHead++ % RX_SIZE] = buf[cnt];
+    }
+    return cnt;
+}
+
+size_t SimSerial::drain(uint8_t *buf, size_t len)
+{
+    size_t cnt = 0;
+    while (cnt < len && _txHead != _txTail)
+        buf[cnt++] = _tx[_txTail++ % TX_SIZE];
+    return cnt;
+}
+
+void SimJoystick::button(unsigned int num, bool val)
+{
+    if (--num >= 128)
+        return;
+    uint32_t *p = usb_joystick_data + (num >> 5);
+    num &= 0x1F;
+    if (val)
+        *p |= (1 << num);
+    else
+        *p &= ~(1 << num);
+    if (!_manualMode)
+        send_now();
+}
+
+void SimJoystick::slider(unsigned int num, unsigned int position)
+{
+    if (--num >= 17)
+        return;
+    analog16(num + 6, position);
+}
+
+void SimJoystick::hat(unsigned int num, int angle)
+{
+    if (--num >= 4)
+        return;
+    uint32_t val = angle < 0 ? 15 : ((angle + 22) / 45) % 8;
+    uint32_t shift = 16 + num * 4;
+    usb_joystick_data[15] = (usb_joystick_data[15] & ~(0xFu << shift)) | (val << shift);
+    if (!_manualMode)
+        send_now();
+}
+
+void SimJoystick::analog16(unsigned int num, unsigned int value)
+{
+    if (value > 0xFFFF)
+        value = 0xFFFF;
+    uint16_t *p = (uint16_t *)(&usb_joystick_data[4]);
+    p[num] = value;
+    if (!_manualMode)
+        send_now();
+}
+
+void SimJoystick::send_now()
+{
+    memcpy(_lastReport, usb_joystick_data, sizeof(_lastReport));
+    _lastSendUs = micros();
+    ++_reportsSent;
+}
+
+#endif // !ARDUINO
@@ -0,0 +1,161 @@
+#pragma once
+
+// Host implementation of the Hal, a virtual clock and in-memory serial ports that
+// the simulation feeds and drains. Only used when building without ARDUINO.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <type_traits>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define LED_BUILTIN 13
+#define DEC 10
+#define HEX 16
+#define SERIAL_8N1 0x00
+#define SERIAL_8E2_RXINV_TXINV 0x3F
+#define JOYSTICK_SIZE 64
+
+// Virtual clock, only moves when the simulation advances it
+class SimClock
+{
+public:
+    static uint64_t now() { return _us; }
+    static void advance(uint32_t us) { _us += us; }
+    static void set(uint64_t us) { _us = us; }
+
+private:
+    static uint64_t _us;
+};
+
+static inline uint32_t micros() { return (uint32_t)SimClock::now(); }
+static inline uint32_t millis() { return (uint32_t)(SimClock::now() / 1000); }
+
+void digitalWrite(uint8_t pin, uint8_t val);
+void pinMode(uint8_t pin, uint8_t mode);
+uint8_t simPinState(uint8_t pin);
+
+template <class T, class A, class B, class C, class D>
+long map(T _x, A _in_min, B _in_max, C _out_min, D _out_max)
+{
+    // Same rounding as the Teensy core
+    long x = _x, in_min = _in_min, in_max = _in_max, out_min = _out_min, out_max = _out_max;
+    if ((in_max - in_min) > (out_max - out_min))
+        return (x - in_min) * (out_max - out_min + 1) / (in_max - in_min + 1) + out_min;
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+template <class A, class B>
+static inline typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+template <class A, class B>
+static inline typename std::common_type<A, B>::type max(A a, B b) { return a > b ? a : b; }
+
+// Serial port backed by two rings. The firmware side has the Arduino interface,
+// the simulation injects received bytes and drains written ones.
+// No constructor on purpose, instances are zero initialised before any static
+// object (like a CrsfSerial) calls begin() on them.
+class SimSerial
+{
+public:
+    static const size_t RX_SIZE = 4096;
+    static const size_t TX_SIZE = 4096;
+
+    void begin(uint32_t baud, uint32_t config = SERIAL_8N1) { _baud = baud; _config = config; }
+    void end() {}
+    int available() const { return (int)(_rxHead - _rxTail); }
+    int read();
+    int peek() const;
+    size_t readBytes(char *buf, size_t len);
+    size_t readBytes(uint8_t *buf, size_t len) { return readBytes((char *)buf, len); }
+    int availableForWrite() const { return (int)(TX_SIZE - (_txHead - _txTail)); }
+    size_t write(uint8_t b);
+    size_t write(const uint8_t *buf, size_t len);
+    size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+    void flush() {}
+    void send_now() {}
+    // Grows the receive buffer like the Teensy UARTs do, up to RX_SIZE
+    void addMemoryForRead(void *, size_t len) { setRxCapacity(rxCapacity() + len); }
+
+    size_t print(const char *str) { return write(str); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t println() { return write("\r\n"); }
+    template <class T>
+    size_t println(T val) { return print(val) + println(); }
+    template <class T>
+    size_t println(T val, int base) { return print(val, base) + println(); }
+    int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    // Simulation side
+    uint32_t baud() const { return _baud; }
+    uint32_t config() const { return _config; }
+    size_t inject(const uint8_t *buf, size_t len);
+    size_t drain(uint8_t *buf, size_t len);
+    uint32_t rxOverruns() const { return _rxOverruns; }
+    // Model a smaller hardware receive buffer, inject() drops what doesn't fit
+    void setRxCapacity(size_t len) { _rxLimit = len < RX_SIZE ? len : RX_SIZE; }
+    size_t rxCapacity() const { return _rxLimit ? _rxLimit : RX_SIZE; }
+
+private:
+    uint8_t _rx[RX_SIZE];
+    uint8_t _tx[TX_SIZE];
+    size_t _rxHead, _rxTail;
+    size_t _txHead, _txTail;
+    uint32_t _baud;
+    uint32_t _config;
+    uint32_t _rxOverruns;
+    size_t _rxLimit; // 0 is RX_SIZE
+};
+
+typedef SimSerial HalUart;
+typedef SimSerial HalUart1;
+typedef SimSerial HalUart2;
+typedef SimSerial HalUart3;
+typedef SimSerial HalUsb;
+
+// Joystick with the Teensy core's 64 byte report layout:
+// 128 buttons, 6 axes + 17 sliders at 16-bit, 4 hats
+extern uint32_t usb_joystick_data[(JOYSTICK_SIZE + 3) / 4];
+
+class SimJoystick
+{
+public:
+    void button(unsigned int num, bool val);
+    void X(unsigned int position) { analog16(0, position); }
+    void Y(unsigned int position) { analog16(1, position); }
+    void Z(unsigned int position) { analog16(2, position); }
+    void Xrotate(unsigned int position) { analog16(3, position); }
+    void Yrotate(unsigned int position) { analog16(4, position); }
+    void Zrotate(unsigned int position) { analog16(5, position); }
+    void slider(unsigned int num, unsigned int position);
+    void hat(unsigned int num, int angle);
+    void useManualSend(bool mode) { _manualMode = mode; }
+    void send_now();
+
+    // Simulation side
+    uint32_t reportsSent() const { return _reportsSent; }
+    uint32_t lastSendUs() const { return _lastSendUs; }
+    const uint32_t *lastReport() const { return _lastReport; }
+
+private:
+    void analog16(unsigned int num, unsigned int value);
+
+    bool _manualMode;
+    uint32_t _reportsSent;
+    uint32_t _lastSendUs;
+    uint32_t _lastReport[(JOYSTICK_SIZE + 3) / 4];
+};
+
+extern SimSerial Serial;
+extern SimSerial Serial1;
+extern SimSerial Serial2;
+extern SimSerial Serial3;
+extern SimJoystick Joystick;
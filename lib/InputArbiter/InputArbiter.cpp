@@ -0,0 +1,86 @@
+#include "InputArbiter.h"
+#include <string.h>
+
+InputArbiter::InputArbiter(uint16_t timeoutMs, uint16_t holdMs) :
+    _active(INPUT_NONE), _switches(0), _timeoutMs(timeoutMs), _holdMs(holdMs), _rateStartMs(0)
+{
+    memset(_sources, 0, sizeof(_sources));
+}
+
+bool InputArbiter::onFrame(uint8_t source, uint8_t status, uint32_t nowMs)
+{
+    if (source >= INPUT_SOURCES)
+        return false;
+
+    Source &s = _sources[source];
+    ++s.frames;
+    ++s.rateFrames;
+    if (status == FRAME_OK)
+    {
+        if (!s.healthy)
+            s.healthySinceMs = nowMs;
+        s.healthy = true;
+        s.lastOkMs = nowMs;
+    }
+    else if (status == FRAME_LOST)
+        ++s.lost;
+    else
+    {
+        ++s.failsafes;
+        s.healthy = false;
+    }
+
+    loop(nowMs);
+    return status == FRAME_OK && source == _active;
+}
+
+void InputArbiter::loop(uint32_t nowMs)
+{
+    for (uint8_t i = 0; i < INPUT_SOURCES; ++i)
+        if (_sources[i].healthy && nowMs - _sources[i].lastOkMs > _timeoutMs)
+            _sources[i].healthy = false;
+
+    updateRates(nowMs);
+    select(nowMs);
+}
+
+void InputArbiter::updateRates(uint32_t nowMs)
+{
+    if (nowMs - _rateStartMs < 1000)
+        return;
+
+    // A whole second without a call (or the first one) leaves no valid count
+    bool valid = nowMs - _rateStartMs < 2000;
+    for (uint8_t i = 0; i < INPUT_SOURCES; ++i)
+    {
+        _sources[i].rate = valid ? _sources[i].rateFrames : 0;
+        _sources[i].rateFrames = 0;
+    }
+    _rateStartMs = nowMs;
+}
+
+void InputArbiter::select(uint32_t nowMs)
+{
+    bool activeHealthy = _active != INPUT_NONE && _sources[_active].healthy;
+    uint8_t best = activeHealthy ? _active : (uint8_t)INPUT_NONE;
+
+    for (uint8_t i = 0; i < INPUT_SOURCES; ++i)
+    {
+        const Source &s = _sources[i];
+        if (i == best)
+            break; // nothing preferred over the active source qualifies
+        if (!s.healthy)
+            continue;
+        // Taking over from a healthy source needs a stable link, replacing a dead one doesn't
+        if (activeHealthy && nowMs - s.healthySinceMs < _holdMs)
+            continue;
+        best = i;
+        break;
+    }
+
+    if (best != _active)
+    {
+        _active = best;
+        ++_switches;
+    }
+}
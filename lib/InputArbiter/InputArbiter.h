@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+// Sources in order of preference
+enum eInputSource
+{
+    INPUT_CRSF,
+    INPUT_SBUS,
+    INPUT_SOURCES,
+    INPUT_NONE = 0xFF
+};
+
+enum eFrameStatus
+{
+    FRAME_OK,
+    FRAME_LOST,     // receiver repeated old values, doesn't count as fresh
+    FRAME_FAILSAFE, // source is unusable right away
+};
+
+// Picks which receiver drives the joystick.
+// A source is healthy while it delivered an OK frame within the timeout and no failsafe
+// since. When the active source turns unhealthy the most preferred healthy one takes over
+// at once, a more preferred source only takes over again once it has been healthy for
+// the hold time, so a flapping link doesn't make the output jump back and forth.
+class InputArbiter
+{
+public:
+    struct Source
+    {
+        uint32_t frames;
+        uint32_t lost;
+        uint32_t failsafes;
+        uint32_t lastOkMs;
+        uint32_t healthySinceMs;
+        uint16_t rate;       // frames per second in the last full second
+        uint16_t rateFrames; // frames so far in the current second
+        bool healthy;
+    };
+
+    InputArbiter(uint16_t timeoutMs = 100, uint16_t holdMs = 500);
+
+    // Returns true if the frame's channels should be used, that is the source is active
+    bool onFrame(uint8_t source, uint8_t status, uint32_t nowMs);
+    // Call from the main loop, catches sources that just stopped sending
+    void loop(uint32_t nowMs);
+
+    uint8_t getActive() const { return _active; }
+    const Source &getSource(uint8_t source) const { return _sources[source]; }
+    uint32_t getSwitches() const { return _switches; }
+    uint16_t getTimeout() const { return _timeoutMs; }
+    uint16_t getHold() const { return _holdMs; }
+    void setTimeout(uint16_t ms) { _timeoutMs = ms; }
+    void setHold(uint16_t ms) { _holdMs = ms; }
+
+private:
+    Source _sources[INPUT_SOURCES];
+    uint8_t _active;
+    uint32_t _switches;
+    uint16_t _timeoutMs;
+    uint16_t _holdMs;
+    uint32_t _rateStartMs;
+
+    void updateRates(uint32_t nowMs);
+    void select(uint32_t nowMs);
+};
@@ -0,0 +1,118 @@
+#include <string.h>
+#include "InputCapture.h"
+
+void InputCapture::start(uint32_t us)
+{
+    _head = _tail = 0;
+    _open = false;
+    _lastUs = us;
+    _bytes = 0;
+    _lost = 0;
+    for (uint8_t i = 0; i < sizeof(CAPTURE_MAGIC); ++i)
+        put(CAPTURE_MAGIC[i]);
+    put(CAPTURE_VERSION);
+    _active = true;
+}
+
+void InputCapture::stop()
+{
+    if (!_active)
+        return;
+    _active = false;
+    _open = false;
+    // record() always leaves room for this
+    put(CAPTURE_TAG_END);
+}
+
+void InputCapture::record(uint8_t source, uint32_t us, uint8_t b)
+{
+    if (!_active)
+        return;
+
+    if (_open && source == _openSource && us == _openUs && (_buf[_tagPos] & CAPTURE_MAX_RECORD) < CAPTURE_MAX_RECORD)
+    {
+        // Keep one byte free for the end tag
+        if (space() < 2)
+        {
+            ++_lost;
+            return;
+        }
+        put(b);
+        ++_buf[_tagPos];
+        ++_bytes;
+        return;
+    }
+
+    // Tag, up to 5 bytes of delta, the byte and the end tag
+    if (space() < 8)
+    {
+        _open = false;
+        ++_lost;
+        return;
+    }
+
+    uint32_t delta = us - _lastUs;
+    _lastUs = us;
+    _tagPos = _head;
+    put((source << 6) | 1);
+    while (delta >= 0x80)
+    {
+        put((delta & 0x7F) | 0x80);
+        delta >>= 7;
+    }
+    put(delta);
+    put(b);
+    ++_bytes;
+
+    _open = true;
+    _openSource = source;
+    _openUs = us;
+}
+
+const uint8_t *InputCapture::peek(size_t *len)
+{
+    // The tag count of a record can't change once it's been sent
+    _open = false;
+    *len = (_head >= _tail) ? _head - _tail : BUF_SIZE - _tail;
+    return &_buf[_tail];
+}
+
+void InputCapture::consume(size_t len)
+{
+    _tail = (_tail + len) & (BUF_SIZE - 1);
+}
+
+CaptureReader::CaptureReader(const uint8_t *data, size_t len) :
+    _data(data), _len(len), _pos(sizeof(CAPTURE_MAGIC) + 1), _us(0)
+{
+    _valid = len > sizeof(CAPTURE_MAGIC) && memcmp(data, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) == 0 &&
+             data[sizeof(CAPTURE_MAGIC)] == CAPTURE_VERSION;
+}
+
+bool CaptureReader::next(uint8_t *source, uint32_t *us, const uint8_t **bytes, uint8_t *len)
+{
+    if (!_valid || _pos >= _len || _data[_pos] == CAPTURE_TAG_END)
+        return false;
+
+    uint8_t tag = _data[_pos++];
+    uint32_t delta = 0;
+    for (uint8_t shift = 0; _pos < _len; shift += 7)
+    {
+        uint8_t b = _data[_pos++];
+        delta |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            break;
+    }
+
+    uint8_t cnt = tag & CAPTURE_MAX_RECORD;
+    if (_pos + cnt > _len)
+        return false;
+
+    _us += delta;
+    *source = tag >> 6;
+    *us = _us;
+    *bytes = &_data[_pos];
+    *len = cnt;
+    _pos += cnt;
+    return true;
+}
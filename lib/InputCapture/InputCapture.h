@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary capture of raw receiver UART bytes with their arrival time, so field
+// problems can be replayed through the parser on the host.
+//
+// Stream layout:
+//   header  "RXCP" + version byte
+//   record  tag, LEB128 delta in us since the previous record (or the start), 1-63 raw bytes
+//           tag bits 7..6 are the source (CAPTURE_SOURCE_*), bits 5..0 the byte count
+//   end     CAPTURE_TAG_END
+enum eCaptureSource
+{
+    CAPTURE_SOURCE_CRSF = 0,
+    CAPTURE_SOURCE_SBUS = 1,
+    CAPTURE_SOURCE_CRSF2 = 2, // second receiver
+};
+
+static const uint8_t CAPTURE_MAGIC[4] = {'R', 'X', 'C', 'P'};
+static const uint8_t CAPTURE_VERSION = 1;
+static const uint8_t CAPTURE_TAG_END = 0x00;
+static const uint8_t CAPTURE_MAX_RECORD = 0x3F;
+
+// Recorder, encodes into a small ring that the main loop streams out in bulk.
+// Bytes that don't fit are counted in lost(), the stream itself stays valid.
+class InputCapture
+{
+public:
+    static const uint16_t BUF_SIZE = 1024; // power of 2
+
+    void start(uint32_t us);
+    void stop();
+    bool active() const { return _active; }
+
+    // One received byte, bytes from the same source with the same timestamp share a record
+    void record(uint8_t source, uint32_t us, uint8_t b);
+
+    // Encoded data ready to send, contiguous, closes the record being built
+    const uint8_t *peek(size_t *len);
+    void consume(size_t len);
+
+    uint32_t bytes() const { return _bytes; }
+    uint32_t lost() const { return _lost; }
+
+private:
+    uint8_t _buf[BUF_SIZE];
+    uint16_t _head;
+    uint16_t _tail;
+    uint16_t _tagPos; // tag of the record being built
+    bool _active;
+    bool _open;
+    uint8_t _openSource;
+    uint32_t _openUs;
+    uint32_t _lastUs;
+    uint32_t _bytes;
+    uint32_t _lost;
+
+    uint16_t space() const { return BUF_SIZE - 1 - ((_head - _tail) & (BUF_SIZE - 1)); }
+    void put(uint8_t b) { _buf[_head] = b; _head = (_head + 1) & (BUF_SIZE - 1); }
+};
+
+// Walks a complete capture, for replay
+class CaptureReader
+{
+public:
+    CaptureReader(const uint8_t *data, size_t len);
+    bool valid() const { return _valid; }
+    // Next record, us is the arrival time relative to the start of the capture
+    bool next(uint8_t *source, uint32_t *us, const uint8_t **bytes, uint8_t *len);
+
+private:
+    const uint8_t *_data;
+    size_t _len;
+    size_t _pos;
+    uint32_t _us;
+    bool _valid;
+};
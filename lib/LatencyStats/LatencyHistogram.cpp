@@ -0,0 +1,69 @@
+#include <string.h>
+#include "LatencyHistogram.h"
+
+void LatencyHistogram::reset()
+{
+    memset(_buckets, 0, sizeof(_buckets));
+    _count = 0;
+    _min = UINT32_MAX;
+    _max = 0;
+}
+
+void LatencyHistogram::add(uint32_t us)
+{
+    ++_buckets[bucketOf(us)];
+    ++_count;
+    if (us < _min)
+        _min = us;
+    if (us > _max)
+        _max = us;
+}
+
+uint32_t LatencyHistogram::percentile(uint8_t pct) const
+{
+    if (_count == 0)
+        return 0;
+
+    // Rank of the sample we are after, 1-based
+    uint32_t rank = ((uint64_t)_count * pct + 99) / 100;
+    if (rank == 0)
+        rank = 1;
+
+    uint32_t seen = 0;
+    for (uint8_t idx = 0; idx < BUCKETS; ++idx)
+    {
+        seen += _buckets[idx];
+        if (seen >= rank)
+        {
+            if (idx == BUCKETS - 1)
+                return _max;
+            uint32_t upper = bucketUpper(idx);
+            // Never report beyond what was actually measured
+            return upper > _max ? _max : upper;
+        }
+    }
+    return _max;
+}
+
+uint8_t LatencyHistogram::bucketOf(uint32_t us)
+{
+    if (us < LINEAR)
+        return us;
+
+    uint8_t log2 = 31 - __builtin_clz(us);
+    if (log2 >= MAX_LOG2)
+        return BUCKETS - 1;
+
+    uint8_t sub = (us >> (log2 - 3)) & (SUB_BUCKETS - 1);
+    return LINEAR + (log2 - 4) * SUB_BUCKETS + sub;
+}
+
+uint32_t LatencyHistogram::bucketUpper(uint8_t idx)
+{
+    if (idx < LINEAR)
+        return idx;
+
+    uint8_t log2 = (idx - LINEAR) / SUB_BUCKETS + 4;
+    uint8_t sub = (idx - LINEAR) % SUB_BUCKETS;
+    return ((uint32_t)(SUB_BUCKETS + sub + 1) << (log2 - 3)) - 1;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+// Fixed size latency histogram in microseconds, no allocation.
+// Buckets are exact below 16 us, above that each power of two is split in 8
+// so percentiles are within 12.5%. Min and max are exact.
+class LatencyHistogram
+{
+public:
+    static const uint8_t LINEAR = 16;
+    static const uint8_t SUB_BUCKETS = 8;
+    static const uint8_t MAX_LOG2 = 20; // everything from ~1s up lands in the last bucket
+    static const uint8_t BUCKETS = LINEAR + (MAX_LOG2 - 4) * SUB_BUCKETS;
+
+    LatencyHistogram() { reset(); }
+    void reset();
+    void add(uint32_t us);
+
+    uint32_t count() const { return _count; }
+    uint32_t minimum() const { return _count ? _min : 0; }
+    uint32_t maximum() const { return _max; }
+    // Upper bound of the bucket holding the pct-th percentile
+    uint32_t percentile(uint8_t pct) const;
+
+private:
+    uint32_t _buckets[BUCKETS];
+    uint32_t _count;
+    uint32_t _min;
+    uint32_t _max;
+
+    static uint8_t bucketOf(uint32_t us);
+    static uint32_t bucketUpper(uint8_t idx);
+};
@@ -0,0 +1,88 @@
+#include "RollingWindow.h"
+#include <string.h>
+
+void RollingWindow::reset(uint32_t nowMs)
+{
+    memset(_blocks, 0, sizeof(_blocks));
+    _current = 0;
+    _blockStartMs = nowMs;
+}
+
+void RollingWindow::roll(uint32_t nowMs)
+{
+    uint32_t elapsed = nowMs - _blockStartMs;
+    if (elapsed < _blockMs)
+        return;
+    if (elapsed >= (uint32_t)_blockMs * BLOCKS)
+    {
+        // Nothing in the window is recent enough anymore
+        reset(nowMs - elapsed % _blockMs);
+        return;
+    }
+
+    while (nowMs - _blockStartMs >= _blockMs)
+    {
+        _current = (_current + 1) % BLOCKS;
+        memset(&_blocks[_current], 0, sizeof(Block));
+        _blockStartMs += _blockMs;
+    }
+}
+
+void RollingWindow::add(int16_t value, uint32_t nowMs)
+{
+    roll(nowMs);
+    Block &b = _blocks[_current];
+    if (b.count == 0 || value < b.min)
+        b.min = value;
+    if (b.count == 0 || value > b.max)
+        b.max = value;
+    b.sum += value;
+    if (b.count < UINT16_MAX)
+        ++b.count;
+}
+
+uint32_t RollingWindow::count() const
+{
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < BLOCKS; ++i)
+        total += _blocks[i].count;
+    return total;
+}
+
+int16_t RollingWindow::minimum() const
+{
+    bool any = false;
+    int16_t result = 0;
+    for (uint8_t i = 0; i < BLOCKS; ++i)
+        if (_blocks[i].count && (!any || _blocks[i].min < result))
+        {
+            result = _blocks[i].min;
+            any = true;
+        }
+    return result;
+}
+
+int16_t RollingWindow::maximum() const
+{
+    bool any = false;
+    int16_t result = 0;
+    for (uint8_t i = 0; i < BLOCKS; ++i)
+        if (_blocks[i].count && (!any || _blocks[i].max > result))
+        {
+            result = _blocks[i].max;
+            any = true;
+        }
+    return result;
+}
+
+int16_t RollingWindow::mean() const
+{
+    int32_t sum = 0;
+    uint32_t cnt = 0;
+    for (uint8_t i = 0; i < BLOCKS; ++i)
+    {
+        sum += _blocks[i].sum;
+        cnt += _blocks[i].count;
+    }
+    return cnt ? sum / (int32_t)cnt : 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+// Min, mean and max of the samples of the last BLOCKS * blockMs milliseconds, no allocation.
+// Samples are folded into the block for their time slot, old blocks are cleared as time
+// moves on, so adding and reading are both constant time.
+class RollingWindow
+{
+public:
+    static const uint8_t BLOCKS = 10;
+
+    RollingWindow(uint16_t blockMs = 1000) : _blockMs(blockMs) { reset(0); }
+    void reset(uint32_t nowMs);
+    void add(int16_t value, uint32_t nowMs);
+    // Age out blocks without adding, call before reading
+    void roll(uint32_t nowMs);
+
+    uint32_t count() const;
+    int16_t minimum() const;
+    int16_t maximum() const;
+    int16_t mean() const;
+
+private:
+    struct Block
+    {
+        int16_t min;
+        int16_t max;
+        int32_t sum;
+        uint16_t count;
+    };
+
+    Block _blocks[BLOCKS];
+    uint8_t _current;
+    uint32_t _blockStartMs;
+    uint16_t _blockMs;
+};
@@ -0,0 +1,174 @@
+#include "LinkEmulator.h"
+#include <string.h>
+
+const char *const LinkEmulator::JITTER_NAMES[JITTERS] = {"uniform", "normal", "exponential"};
+
+LinkEmulator::LinkEmulator() :
+    _head(0), _count(0), _lastDueUs(0), _rng(0x2545F491), _lastPushUs(0), _periodUs(0), _delayUs(0), _jitterUs(0), _dist(JITTER_UNIFORM),
+    _dropPct(0), _burst(1), _burstLeft(0), _decimate(1), _decimateCount(0)
+{
+    resetStats();
+}
+
+void LinkEmulator::off()
+{
+    _delayUs = 0;
+    _jitterUs = 0;
+    _dropPct = 0;
+    _burstLeft = 0;
+    _decimate = 1;
+    _decimateCount = 0;
+    _count = 0;
+}
+
+void LinkEmulator::resetStats()
+{
+    _passed = 0;
+    _dropped = 0;
+    _decimated = 0;
+    _overflows = 0;
+    _capped = 0;
+    _added.reset();
+}
+
+uint32_t LinkEmulator::getLimit() const
+{
+    uint64_t limit = (uint64_t)(RING_SIZE - RING_HEADROOM) * (_periodUs ? _periodUs : MIN_PERIOD_US) * _decimate;
+    return limit < MAX_DELAY_US ? limit : MAX_DELAY_US;
+}
+
+// Before any frames there is no rate to judge by, push() still caps them
+bool LinkEmulator::fitsLimit() const
+{
+    uint32_t jitter = _dist == JITTER_EXPONENTIAL ? 2 * _jitterUs : _jitterUs;
+    return _periodUs == 0 || _delayUs + jitter <= getLimit();
+}
+
+bool LinkEmulator::setDelay(uint32_t us)
+{
+    _delayUs = us < MAX_DELAY_US ? us : MAX_DELAY_US;
+    return fitsLimit();
+}
+
+bool LinkEmulator::setJitter(uint32_t us)
+{
+    _jitterUs = us < MAX_DELAY_US ? us : MAX_DELAY_US;
+    return fitsLimit();
+}
+
+bool LinkEmulator::setDistribution(uint8_t dist)
+{
+    if (dist >= JITTERS)
+        return false;
+    _dist = dist;
+    return true;
+}
+
+// xorshift32, repeatable runs matter more here than the quality of the numbers
+uint32_t LinkEmulator::random()
+{
+    _rng ^= _rng << 13;
+    _rng ^= _rng >> 17;
+    _rng ^= _rng << 5;
+    return _rng;
+}
+
+uint32_t LinkEmulator::jitter()
+{
+    if (_jitterUs == 0)
+        return 0;
+
+    uint32_t r = random();
+    switch (_dist)
+    {
+    case JITTER_NORMAL:
+    {
+        uint32_t r2 = random();
+        uint32_t sum = (r & 0xFFFF) + (r >> 16) + (r2 & 0xFFFF) + (r2 >> 16);
+        return ((uint64_t)_jitterUs * sum) >> 18;
+    }
+    case JITTER_EXPONENTIAL:
+    {
+        // -log2 of r / 2^32 in Q8: the leading zeros and the mantissa as a straight line,
+        // good to a few percent which is plenty for this
+        if (r == 0)
+            r = 1;
+        uint8_t lz = __builtin_clz(r);
+        uint32_t frac = ((r << lz) >> 23) & 0xFF;
+        uint32_t log2Q8 = (lz + 1) * 256 - frac;
+        // mean jitter / 4, ln(2) is 177 / 256
+        uint32_t us = ((uint64_t)_jitterUs * log2Q8 * 177) >> 18;
+        return us < 2 * _jitterUs ? us : 2 * _jitterUs;
+    }
+    default:
+        return ((uint64_t)_jitterUs * (r >> 16)) >> 16;
+    }
+}
+
+void LinkEmulator::push(const uint16_t *raw, uint8_t source, uint32_t arrivalUs, uint32_t nowUs)
+{
+    // The frame rate, smoothed by an eighth so one late frame doesn't move the limit much
+    uint32_t interval = nowUs - _lastPushUs;
+    if (_lastPushUs && interval < MAX_PERIOD_US)
+        _periodUs = _periodUs ? _periodUs + ((int32_t)(interval - _periodUs) >> 3) : interval;
+    _lastPushUs = nowUs;
+
+    if (++_decimateCount < _decimate)
+    {
+        ++_decimated;
+        return;
+    }
+    _decimateCount = 0;
+
+    // A loss starts with dropPct / burst so about dropPct of all frames are lost
+    if (_burstLeft == 0 && _dropPct && (random() >> 16) < (uint32_t)_dropPct * 65536 / 100 / _burst)
+        _burstLeft = _burst;
+    if (_burstLeft)
+    {
+        --_burstLeft;
+        ++_dropped;
+        return;
+    }
+
+    if (_count == RING_SIZE)
+    {
+        ++_overflows;
+        return;
+    }
+
+    uint32_t added = _delayUs + jitter();
+    uint32_t limit = getLimit();
+    if (added > limit)
+    {
+        added = limit;
+        ++_capped;
+    }
+    uint32_t due = nowUs + added;
+    // In order, a frame can't leave before the one in front of it
+    if (_count && (int32_t)(due - _lastDueUs) < 0)
+        due = _lastDueUs;
+    _lastDueUs = due;
+
+    Frame &frame = _ring[(_head + _count) & (RING_SIZE - 1)];
+    frame.dueUs = due;
+    frame.arrivalUs = arrivalUs;
+    frame.pushedUs = nowUs;
+    frame.source = source;
+    memcpy(frame.raw, raw, sizeof(frame.raw));
+    ++_count;
+}
+
+const LinkEmulator::Frame *LinkEmulator::pop(uint32_t nowUs)
+{
+    if (_count == 0)
+        return NULL;
+    const Frame &frame = _ring[_head];
+    if ((int32_t)(nowUs - frame.dueUs) < 0)
+        return NULL;
+
+    _head = (_head + 1) & (RING_SIZE - 1);
+    --_count;
+    ++_passed;
+    _added.add(nowUs - frame.pushedUs);
+    return &frame;
+}
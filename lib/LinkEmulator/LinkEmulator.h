@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdint.h>
+#include <LatencyHistogram.h>
+
+// Emulates a worse radio link between the receiver and the joystick for latency testing.
+// Frames go into a ring with the time they are due, the main loop takes them out again once
+// that time has passed, so any delay costs the same per frame: one copy in, one copy out.
+// The delay is fixed plus a random part (jitter), frames can be lost at random (drop) and
+// the frame rate divided (decimate). Frames never overtake each other, a frame that drew a
+// short delay waits for the one before it, like on a real link.
+// The ring holds RING_SIZE frames, so how long they can be held depends on the frame rate:
+// push() measures it and caps the delay at getLimit() instead of losing frames to a full ring.
+// The settings are kept as they were given, at a lower rate the full delay applies again.
+class LinkEmulator
+{
+public:
+    // How the random part of the delay is spread over 0..jitter
+    enum eJitter
+    {
+        JITTER_UNIFORM,     // every value equally likely
+        JITTER_NORMAL,      // bell around jitter / 2 (sum of four uniforms)
+        JITTER_EXPONENTIAL, // mostly short with a long tail, mean jitter / 4, capped at 2 * jitter
+        JITTERS
+    };
+    static const char *const JITTER_NAMES[JITTERS];
+
+    static const uint8_t CHANNELS = 16;
+    static const uint16_t RING_SIZE = 256; // power of 2, frames in flight, 256 ms at 1 kHz
+    static const uint16_t RING_HEADROOM = 32; // frames kept free for a rate that runs ahead of the estimate
+    static const uint32_t MAX_DELAY_US = 1000000;
+    static const uint32_t MIN_PERIOD_US = 500;    // 2 kHz, assumed until the rate is measured
+    static const uint32_t MAX_PERIOD_US = 100000; // longer between frames is an outage, not the rate
+
+    struct Frame
+    {
+        uint32_t dueUs;
+        uint32_t arrivalUs; // of the frame at the receiver, kept for the frame clock
+        uint32_t pushedUs;
+        uint8_t source;
+        uint16_t raw[CHANNELS];
+    };
+
+    LinkEmulator();
+
+    // Anything set means frames go through the ring, otherwise they should skip it
+    bool isActive() const { return _delayUs || _jitterUs || _dropPct || _decimate > 1; }
+    // Back to a perfect link, frames still in the ring are lost
+    void off();
+
+    // A frame that arrived at arrivalUs is handed over at nowUs, it comes out of pop() later or never.
+    // The delay counts from nowUs, so it is what the emulation adds on top of the real pipeline.
+    void push(const uint16_t *raw, uint8_t source, uint32_t arrivalUs, uint32_t nowUs);
+    // Oldest frame that is due at nowUs, NULL if there is none. Valid until the next push().
+    const Frame *pop(uint32_t nowUs);
+
+    // Longest delay the ring holds at the measured frame rate, frames leave after that
+    uint32_t getLimit() const;
+    // False if delay and the longest jitter don't fit in getLimit() at the measured rate
+    bool setDelay(uint32_t us);
+    bool setJitter(uint32_t us);
+    bool setDistribution(uint8_t dist);
+    // Percent of the frames that are lost, each loss takes burst frames in a row
+    void setDrop(uint8_t pct) { _dropPct = pct < 100 ? pct : 100; }
+    void setBurst(uint8_t frames) { _burst = frames ? frames : 1; }
+    // Only every n-th frame gets through, 1 passes all
+    void setDecimate(uint8_t n) { _decimate = n ? n : 1; }
+
+    uint32_t getDelay() const { return _delayUs; }
+    uint32_t getJitter() const { return _jitterUs; }
+    uint8_t getDistribution() const { return _dist; }
+    uint8_t getDrop() const { return _dropPct; }
+    uint8_t getBurst() const { return _burst; }
+    uint8_t getDecimate() const { return _decimate; }
+    // Time between the frames handed to push(), 0 until two came in
+    uint32_t getFramePeriod() const { return _periodUs; }
+
+    uint16_t getQueued() const { return _count; }
+    uint32_t getPassed() const { return _passed; }
+    uint32_t getDropped() const { return _dropped; }
+    uint32_t getDecimated() const { return _decimated; }
+    uint32_t getOverflows() const { return _overflows; }
+    // Frames held for getLimit() instead of the delay they drew
+    uint32_t getCapped() const { return _capped; }
+    // From push() to leaving the ring, what the emulation added
+    const LatencyHistogram &getAdded() const { return _added; }
+    void resetStats();
+
+private:
+    Frame _ring[RING_SIZE];
+    uint16_t _head;
+    uint16_t _count;
+    uint32_t _lastDueUs;
+    uint32_t _rng;
+    uint32_t _lastPushUs;
+    uint32_t _periodUs;
+
+    uint32_t _delayUs;
+    uint32_t _jitterUs;
+    uint8_t _dist;
+    uint8_t _dropPct;
+    uint8_t _burst;
+    uint8_t _burstLeft;
+    uint8_t _decimate;
+    uint8_t _decimateCount;
+
+    uint32_t _passed;
+    uint32_t _dropped;
+    uint32_t _decimated;
+    uint32_t _overflows;
+    uint32_t _capped;
+    LatencyHistogram _added;
+
+    uint32_t random();
+    uint32_t jitter();
+    bool fitsLimit() const;
+};
@@ -0,0 +1,8 @@
+#include "SbusSerial.h"
+
+void SbusSerial::begin()
+{
+    // SBUS is inverted 100000 baud 8E2
+    _port.begin(SBUS_BAUD, SERIAL_8E2_RXINV_TXINV);
+    _pos = 0;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <Hal.h>
+#include <InputCapture.h>
+#include <CrsfChannels.h>
+
+class SbusSerial;
+
+// Event handler for SbusSerial::loop(), bound at compile time like CrsfHandler
+struct SbusHandler
+{
+    void onPacketChannels(SbusSerial &) {}
+};
+
+// SBUS decoder on a Hal UART, works like CrsfSerial: loop() consumes what the UART has
+// and the handler's onPacketChannels() runs for every complete frame, the 16 raw 11-bit
+// channels and the failsafe and lost frame flags of the last frame are available from there on.
+// The loop lives in SbusSerialPort, which knows the UART's class.
+class SbusSerial
+{
+public:
+    static const uint32_t SBUS_BAUD = 100000;
+    static const uint8_t SBUS_FRAME_LEN = 25;
+    static const uint8_t SBUS_HEADER = 0x0F;
+    static const uint8_t SBUS_FOOTER = 0x00;
+    static const uint8_t SBUS2_FOOTER = 0x04;
+    static const uint8_t SBUS2_MASK = 0x0F;
+    static const uint8_t SBUS_FLAG_LOST_FRAME = 0x04;
+    static const uint8_t SBUS_FLAG_FAILSAFE = 0x08;
+
+    void begin();
+    // Record every received byte into capture, NULL to stop
+    void setCapture(InputCapture *capture) { _capture = capture; }
+
+    // Channel value (1-based) of the last frame as received, 11-bit
+    uint16_t getChannelRaw(unsigned int ch) const { return _channels[ch - 1]; }
+    bool isFailsafe() const { return _failsafe; }
+    bool isLostFrame() const { return _lostFrame; }
+
+protected:
+    SbusSerial(HalUart &port) :
+        _port(port), _capture(NULL), _pos(0), _prevByte(SBUS_FOOTER), _failsafe(false), _lostFrame(false), _channels()
+    {
+    }
+
+    HalUart &getPort() { return _port; }
+    template <class Port, class Handler>
+    void handleSerialIn(Port &port, Handler &handler);
+
+private:
+    HalUart &_port;
+    InputCapture *_capture;
+    uint8_t _buf[SBUS_FRAME_LEN];
+    uint8_t _pos;
+    uint8_t _prevByte;
+    bool _failsafe;
+    bool _lostFrame;
+    uint16_t _channels[16];
+
+    static bool isFooter(uint8_t b) { return b == SBUS_FOOTER || (b & SBUS2_MASK) == SBUS2_FOOTER; }
+};
+
+// SbusSerial on a UART of class Port (HalUart1..3), so the byte loop reads it without the vtable
+template <class Port>
+class SbusSerialPort : public SbusSerial
+{
+public:
+    SbusSerialPort(Port &port) : SbusSerial(port) {}
+
+    // Call from main loop, only does work when the UART has bytes
+    template <class Handler>
+    void loop(Handler &handler) { handleSerialIn(static_cast<Port &>(getPort()), handler); }
+};
+
+template <class Port, class Handler>
+void SbusSerial::handleSerialIn(Port &port, Handler &handler)
+{
+    uint32_t now = micros();
+    while (halAvailable(port))
+    {
+        uint8_t b = halRead(port);
+        if (_capture)
+            _capture->record(CAPTURE_SOURCE_SBUS, now, b);
+
+        if (_pos == 0)
+        {
+            // A frame can only start with a header directly after a footer
+            if (b == SBUS_HEADER && isFooter(_prevByte))
+                _buf[_pos++] = b;
+        }
+        else
+        {
+            _buf[_pos++] = b;
+            if (_pos == SBUS_FRAME_LEN)
+            {
+                _pos = 0;
+                _prevByte = b;
+                if (isFooter(b))
+                {
+                    // Channels use the same 11-bit little endian packing as CRSF
+                    crsfUnpackChannels(&_buf[1], _channels);
+                    _lostFrame = _buf[23] & SBUS_FLAG_LOST_FRAME;
+                    _failsafe = _buf[23] & SBUS_FLAG_FAILSAFE;
+                    handler.onPacketChannels(*this);
+                }
+                continue;
+            }
+        }
+        _prevByte = b;
+    }
+}
@@ -0,0 +1,76 @@
+#include "Scheduler.h"
+
+Scheduler::Scheduler(const SchedulerTask *tasks, uint8_t count) :
+    _tasks(tasks), _count(count > MAX_TASKS ? MAX_TASKS : count)
+{
+    memset(_dueUs, 0, sizeof(_dueUs));
+    resetStats();
+}
+
+void Scheduler::resetStats()
+{
+    memset(_stats, 0, sizeof(_stats));
+    _passes = 0;
+}
+
+bool Scheduler::fits(uint8_t idx, uint32_t now) const
+{
+    // The last run time is the estimate. One longer than the whole deadline can't fit any
+    // better on a later pass, waiting would only delay it.
+    uint32_t exec = _stats[idx].lastExecUs;
+    for (uint8_t i = 0; i < idx; ++i)
+    {
+        const SchedulerTask &task = _tasks[i];
+        if (task.periodUs == 0 && exec <= task.deadlineUs && now - _dueUs[i] + exec > task.deadlineUs)
+            return false;
+    }
+    return true;
+}
+
+void Scheduler::loop()
+{
+    ++_passes;
+    // Only read again after a task ran, the clock is not free on every board
+    uint32_t now = micros();
+    for (uint8_t i = 0; i < _count; ++i)
+    {
+        const SchedulerTask &task = _tasks[i];
+        Stats &stats = _stats[i];
+        int32_t late = (int32_t)(now - _dueUs[i]);
+        if (task.periodUs && late < 0)
+            continue;
+        if (stats.runs == 0)
+            late = 0;
+
+        if ((uint32_t)late <= task.deadlineUs && !fits(i, now))
+        {
+            ++stats.deferred;
+            continue;
+        }
+        if ((uint32_t)late > task.deadlineUs)
+            ++stats.misses;
+        if ((uint32_t)late > stats.maxLateUs)
+            stats.maxLateUs = late;
+
+        task.run();
+
+        uint32_t start = now;
+        now = micros();
+        uint32_t exec = now - start;
+        ++stats.runs;
+        stats.lastExecUs = exec;
+        stats.totalExecUs += exec;
+        if (exec > stats.maxExecUs)
+            stats.maxExecUs = exec;
+
+        if (task.periodUs == 0)
+            _dueUs[i] = start;
+        else
+        {
+            // Fell behind by a whole period, start over instead of catching up in a burst
+            _dueUs[i] += task.periodUs;
+            if ((int32_t)(start - _dueUs[i]) >= 0)
+                _dueUs[i] = start + task.periodUs;
+        }
+    }
+}
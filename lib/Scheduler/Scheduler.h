@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Hal.h>
+
+// One line of the static task table, the table order is the priority
+struct SchedulerTask
+{
+    const char *name;
+    void (*run)();
+    uint32_t periodUs;   // 0 runs on every pass
+    uint32_t deadlineUs; // longest acceptable time from due to start, for every pass tasks between two starts
+};
+
+// Cooperative scheduler over a static task table. Each pass goes through the table in priority
+// order and starts the tasks that are due. Before a task starts it has to fit: if its last run
+// would push a more important every pass task (the receivers) past its deadline, it waits a
+// pass, unless that would make it miss its own. Every start and run time is accounted, so
+// whatever delays the RC path shows up as misses and run times in the stats.
+class Scheduler
+{
+public:
+    static const uint8_t MAX_TASKS = 12;
+
+    struct Stats
+    {
+        uint32_t runs;
+        uint32_t misses;   // started later than the deadline
+        uint32_t deferred; // passes waited for a more important task
+        uint32_t maxLateUs;
+        uint32_t lastExecUs;
+        uint32_t maxExecUs;
+        uint64_t totalExecUs;
+    };
+
+    Scheduler(const SchedulerTask *tasks, uint8_t count);
+    // One pass, call from loop()
+    void loop();
+
+    uint8_t getCount() const { return _count; }
+    const SchedulerTask &getTask(uint8_t idx) const { return _tasks[idx]; }
+    const Stats &getStats(uint8_t idx) const { return _stats[idx]; }
+    uint32_t getPasses() const { return _passes; }
+    void resetStats();
+
+private:
+    const SchedulerTask *_tasks;
+    uint8_t _count;
+    uint32_t _passes;
+    uint32_t _dueUs[MAX_TASKS]; // next release, for every pass tasks the last start
+    Stats _stats[MAX_TASKS];
+
+    bool fits(uint8_t idx, uint32_t now) const;
+};
@@ -0,0 +1,75 @@
+#include "SerialBridge.h"
+
+SerialBridge::SerialBridge(HalUsb &usb, HalUart &uart, uint16_t uartRxSize) :
+    _usb(usb), _uart(uart), _uartRxSize(uartRxSize)
+{
+    resetStats();
+}
+
+void SerialBridge::resetStats()
+{
+    _toUart = 0;
+    _toUsb = 0;
+    _uartStalls = 0;
+    _usbStalls = 0;
+    _overruns = 0;
+    _rxHighWater = 0;
+}
+
+size_t SerialBridge::loop()
+{
+    size_t moved = 0;
+
+    // Receiver to host first, the UART buffer is the one that overflows
+    int avail = _uart.available();
+    if (avail > 0)
+    {
+        if (avail > _rxHighWater)
+            _rxHighWater = avail;
+        if (avail >= _uartRxSize)
+            ++_overruns;
+
+        int room = _usb.availableForWrite();
+        if (room <= 0)
+            ++_usbStalls;
+        while (avail > 0 && room > 0)
+        {
+            size_t len = min(min(avail, room), (int)BLOCK_SIZE);
+            len = _uart.readBytes((char *)_buf, len);
+            if (len == 0)
+                break;
+            _usb.write(_buf, len);
+            moved += len;
+            avail -= len;
+            room -= len;
+        }
+        _toUsb += moved;
+        // Don't let a partial USB packet wait for the next one
+        _usb.send_now();
+    }
+
+    // Host to receiver, whatever stays behind is held off by USB flow control
+    avail = _usb.available();
+    if (avail > 0)
+    {
+        int room = _uart.availableForWrite();
+        if (room <= 0)
+            ++_uartStalls;
+        size_t sent = 0;
+        while (avail > 0 && room > 0)
+        {
+            size_t len = min(min(avail, room), (int)BLOCK_SIZE);
+            len = _usb.readBytes((char *)_buf, len);
+            if (len == 0)
+                break;
+            _uart.write(_buf, len);
+            sent += len;
+            avail -= len;
+            room -= len;
+        }
+        _toUart += sent;
+        moved += sent;
+    }
+
+    return moved;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Hal.h>
+
+// Moves bytes between USB serial and a UART in both directions for receiver flashing
+// and configuration. Each pass copies as much as the other side accepts without blocking,
+// in blocks of up to BLOCK_SIZE, so there is no per-byte work besides the copy.
+class SerialBridge
+{
+public:
+    static const uint16_t BLOCK_SIZE = 256;
+
+    // uartRxSize: receive buffer of the UART, a backlog that big means bytes were lost
+    SerialBridge(HalUsb &usb, HalUart &uart, uint16_t uartRxSize);
+    // Returns the number of bytes moved in either direction
+    size_t loop();
+    void resetStats();
+
+    uint32_t getToUart() const { return _toUart; }
+    uint32_t getToUsb() const { return _toUsb; }
+    // Passes where data waited because the other side had no room
+    uint32_t getUartStalls() const { return _uartStalls; }
+    uint32_t getUsbStalls() const { return _usbStalls; }
+    // Passes that found the UART receive buffer full
+    uint32_t getOverruns() const { return _overruns; }
+    // Largest UART receive backlog seen
+    uint16_t getRxHighWater() const { return _rxHighWater; }
+
+private:
+    HalUsb &_usb;
+    HalUart &_uart;
+    uint16_t _uartRxSize;
+    uint32_t _toUart;
+    uint32_t _toUsb;
+    uint32_t _uartStalls;
+    uint32_t _usbStalls;
+    uint32_t _overruns;
+    uint16_t _rxHighWater;
+    uint8_t _buf[BLOCK_SIZE];
+};
@@ -2,6 +2,31 @@
 
 #include <stdint.h>
 
+// Lookup tables for a CRC8 polynomial, generated by the compiler.
+// lut[0] is the classic byte table, lut[k] advances the crc of a byte
+// followed by k zero bytes, which is what the slice-by-4 kernel needs.
+struct Crc8Table
+{
+    uint8_t lut[4][256];
+
+    constexpr Crc8Table(uint8_t poly) : lut()
+    {
+        for (int idx=0; idx<256; ++idx)
+        {
+            uint8_t crc = idx;
+            for (int shift=0; shift<8; ++shift)
+            {
+                crc = (crc << 1) ^ ((crc & 0x80) ? poly : 0);
+            }
+            lut[0][idx] = crc;
+        }
+        for (int slice=1; slice<4; ++slice)
+            for (int idx=0; idx<256; ++idx)
+                lut[slice][idx] = lut[0][lut[slice-1][idx]];
+    }
+};
+
+// Any polynomial, table built at runtime. CRSF frames go through the static CrsfCrc8 in CrsfSerial.
 class Crc8
 {
 public:
@@ -2,26 +2,96 @@
  * CRSF/SBUS USB Joystick by Sjoer van der Ploeg
  *
  * SBUS = Serial1 (pin 0)
- * CRSF = Serial2 (rx pin 9, tx pin 10)
+ * CRSF = Serial2 (rx pin 9, tx pin 10), Teensy 4: rx pin 7, tx pin 8
+ * CRSF diversity receiver = Serial3 (rx pin 7, tx pin 8), Teensy 4: rx pin 15, tx pin 14, see DIVERSITY
  *
  * Channels 1, 2, 3 and 4 are axis; the rest is assumed to be three position switches.
  * Having separate buttons makes setting up simulator functions a breeze!
  *
- * SBUS from bolderflight: https://github.com/bolderflight/SBUS
+ * SBUS decoding based on bolderflight: https://github.com/bolderflight/SBUS
  * CrsfSerial from CapnBry: https://github.com/CapnBry/CRServoF/tree/master/lib/CrsfSerial
  */
 
-#include <Arduino.h>
-#include "SBUS.h"
+#include <Hal.h>
+#include <SbusSerial.h>
 #include <CrsfSerial.h>
+#include <CrsfTelemetry.h>
+#include <CrsfTelemetryFeed.h>
+#include <CrsfDiversity.h>
+#include <CrsfLinkMonitor.h>
+#include <CrsfForwarder.h>
+#include <LatencyHistogram.h>
+#include <InputCapture.h>
+#include <ChannelMap.h>
+#include <SerialBridge.h>
+#include <InputArbiter.h>
+#include <StickInterpolator.h>
+#include <Scheduler.h>
+#include <LinkEmulator.h>
+#include <Blackbox.h>
 
-// Receiver baud rate
-#define BAUD 115200
+// Receiver baud rate, CrsfSerial::BAUD_AUTO finds it (115200 to 1.87M) and searches again after the link is lost
+#define BAUD CrsfSerial::BAUD_AUTO
 
-// Latency testing, this will emulate different refresh rates and/or add latency between input and output.
-// Values are milliseconds.
-#define LATENCY 0  // increase to add latency, 0 means no latency and 255 is the maximum.
-#define INTERVAL 1 // increase to change the refresh interval in milliseconds, USB won't go faster than 1ms anyway!
+// Second CRSF receiver on Serial3, the frames of both are merged (see "get receivers"). Off unless one is
+// connected, with BAUD_AUTO an idle Serial3 would be searched through all rates forever. Can be set with -D DIVERSITY=1.
+#ifndef DIVERSITY
+#define DIVERSITY 0
+#endif
+
+// The host polls the joystick once per USB frame, 1 ms on the Teensy 3's full speed USB and a 125 us
+// microframe on the Teensy 4's high speed USB. Reports sent faster than that only queue up.
+// Can be set with -D USB_FRAME_US=N, for instance to run the native build like a Teensy 4.
+#ifndef USB_FRAME_US
+#if defined(__IMXRT1062__) && defined(JOYSTICK_INTERVAL)
+// The endpoint's bInterval from the core's usb_desc.h, on high speed USB it polls every 2^(n-1) microframes
+#define USB_FRAME_US (125 << (JOYSTICK_INTERVAL - 1))
+#if JOYSTICK_INTERVAL != 1
+#warning "JOYSTICK_INTERVAL in the Teensy core's usb_desc.h is not 1, the joystick is polled less often than every 125 us"
+#endif
+#elif defined(__IMXRT1062__)
+#define USB_FRAME_US 125
+#else
+#define USB_FRAME_US 1000
+#endif
+#endif
+
+// Latency testing, this will emulate a worse link between the receiver and the joystick: delay and jitter
+// in microseconds, lost frames and a lower frame rate. All of it can be changed at runtime, see "get emu".
+#define EMU_DELAY 0            // increase to add latency, 0 means no latency and 1000000 is the maximum.
+#define INTERVAL USB_FRAME_US  // increase to change the refresh interval in microseconds, USB won't go faster than a frame anyway!
+
+// USB report mode, can be changed at runtime with "set report poll|event"
+// REPORT_POLL sends a report every INTERVAL whether anything changed or not.
+// REPORT_EVENT sends as soon as a new frame has been mapped, skips reports that did not change
+// and keeps at least REPORT_SPACING microseconds between reports.
+// Both are microseconds and can be changed at runtime with "set report_interval|report_spacing N",
+// from USB_FRAME_US to 100000.
+#define REPORT_POLL 0
+#define REPORT_EVENT 1
+#define REPORT_MODE REPORT_EVENT
+#define REPORT_SPACING USB_FRAME_US
+
+// HID report layout, can be changed at runtime with "set layout mapped|channels"
+// LAYOUT_MAPPED goes through channelMap below, LAYOUT_CHANNELS has all 16 channels as 16-bit axes
+// and channels 5..16 as buttons 1..36, built in one pass (needs the 64 byte report)
+#define HID_LAYOUT LAYOUT_MAPPED
+
+// Stick axes between RC frames, can be changed at runtime with "set interp off|interpolate|extrapolate"
+// INTERP_LEAD is how far extrapolation may run ahead of the last frame, in percent of the axis travel
+#define INTERP_MODE StickInterpolator::INTERP_OFF
+#define INTERP_LEAD 10
+
+// Extra receive buffer for the CRSF UART, keeps bulk passthrough (receiver flashing) from overrunning
+#define UART_RX_SIZE 64 // Teensy 3 Serial2 default
+#define UART_RX_EXTRA 1024
+
+// Source selection, CRSF is preferred over SBUS. A source is lost after SOURCE_TIMEOUT ms without
+// a good frame (or right away on failsafe), CRSF only takes over again after SOURCE_HOLD ms of good frames.
+// Both can be changed at runtime with "set source_timeout|source_hold N", the timeout from 20 to 5000 ms
+// (SBUS in slow mode sends every 14 ms) and the hold up to 60000 ms.
+#define SOURCE_TIMEOUT 100
+#define SOURCE_HOLD 500
 
 // Number of channels
 #define CHANNELS 16
@@ -34,14 +104,62 @@
 #define US_MIN 988
 #define US_MAX 2011
 
-SBUS sbus(Serial1);
-CrsfSerial crsf(Serial2, 115200);
+SbusSerialPort<HalUart1> sbus(Serial1);
+CrsfSerialPort<HalUart2> crsf(Serial2, BAUD);
+#if DIVERSITY
+CrsfSerialPort<HalUart3> crsf2(Serial3, BAUD); // second receiver, frames of both are merged
+CrsfSerial *const receivers[] = {&crsf, &crsf2};
+#else
+CrsfSerial *const receivers[] = {&crsf};
+#endif
+CrsfDiversity diversity(receivers, sizeof(receivers) / sizeof(receivers[0]));
+CrsfLinkMonitor linkMonitors[sizeof(receivers) / sizeof(receivers[0])]; // rolling link statistics per receiver, see "get stats"
+CrsfTelemetry telemetry(crsf); // telemetry only goes to the first receiver
+CrsfTelemetryFeed telemetryFeed(telemetry); // CRSF telemetry frames from the host, mixed with the CLI
+InputCapture capture; // raw receiver bytes streamed to USB, see "capture start"
+CrsfForwarder forwarder(Serial); // valid CRSF frames streamed to USB, see "forward start"
+Blackbox blackbox; // the last stretch of frames, link statistics and events in RAM, see "blackbox dump"
+SerialBridge bridge(Serial, crsf.getPort(), UART_RX_SIZE + UART_RX_EXTRA); // "serialpassthrough"
+uint8_t uartRxExtra[UART_RX_EXTRA];
 const uint8_t rebootcmd[] = {0xEC, 0x04, 0x32, 0x62, 0x6c, 0x0A};
-const uint8_t crsfbatt[CRSF_FRAME_BATTERY_SENSOR_PAYLOAD_SIZE] = {0, 50, 0, 50, 0, 0, 0, 100}; // fake full 5v battery
-const uint16_t hats[3] = {293, 338, 0};
-uint16_t ch_latency[LATENCY + 1][CHANNELS];
-uint32_t timing[3] = {0, 0, 0};
-bool sbusStatus[2];
+const uint8_t crsfbatt[CRSF_FRAME_BATTERY_SENSOR_PAYLOAD_SIZE] = {0, 50, 0, 50, 0, 0, 0, 100}; // fake full 5v battery until the host sends one
+const int16_t hats[3] = {293, 338, 0};
+InputArbiter arbiter(SOURCE_TIMEOUT, SOURCE_HOLD);
+LinkEmulator emulator; // frames on their way from applyChannels() to the mapper, see "get emu"
+StickInterpolator interp(INTERP_MODE, (uint32_t)AXIS_MAX * INTERP_LEAD / 100);
+const char *const sourceNames[INPUT_SOURCES] = {"CRSF", "SBUS"};
+const char *const layoutNames[LAYOUTS] = {"mapped", "channels"};
+
+struct reportState
+{
+  uint8_t mode;
+  uint32_t interval;
+  uint32_t spacing;
+  bool pending;
+  uint32_t lastSentUs;
+  uint32_t sent;
+  uint32_t suppressed;
+  uint32_t lastReport[sizeof(usb_joystick_data) / sizeof(usb_joystick_data[0])];
+} reportState = {REPORT_MODE, INTERVAL, REPORT_SPACING, false, 0, 0, 0, {0}};
+
+// Stages of a CRSF frame from its first byte on the UART to the USB report, see "get latency"
+enum latencyStage
+{
+  LAT_RX_CRC,
+  LAT_CRC_DISPATCH,
+  LAT_DISPATCH_MAPPED,
+  LAT_MAPPED_USB,
+  LAT_RX_USB,
+  LAT_STAGES
+};
+const char *const latencyNames[LAT_STAGES] = {"rx->crc", "crc->dispatch", "dispatch->mapped", "mapped->usb", "rx->usb"};
+
+struct latencyState
+{
+  LatencyHistogram stages[LAT_STAGES];
+  uint32_t rx, crc, dispatch, mapped; // timestamps of the frame waiting for its report
+  bool pending;
+} latencyState;
 
 struct crsfSerialState
 {
@@ -50,56 +168,206 @@ struct crsfSerialState
   bool serialEcho;
 } crsfState;
 
-void setSticks(uint16_t _min = 1000, uint16_t _max = 2000)
-{
-  // Use 0-1024 for min and mix instad of 0-65535 if you use the normal layout in usb_desc.h
-  Joystick.X(map(ch_latency[0][0], _min, _max, 0, 65535));       // ROLL
-  Joystick.Y(map(ch_latency[0][1], _min, _max, 0, 65535));       // PITCH
-  Joystick.Z(map(ch_latency[0][2], _min, _max, 0, 65535));       // THROTTLE
-  Joystick.Xrotate(map(ch_latency[0][3], _min, _max, 0, 65535)); // YAW
+// Which channel drives what, the tables below turn every channel into HID values with one lookup
+const ChannelMapping channelMap[] = {
+  {0, MAP_AXIS, 0, false}, // ROLL, X
+  {1, MAP_AXIS, 1, false}, // PITCH, Y
+  {2, MAP_AXIS, 2, false}, // THROTTLE, Z
+  {3, MAP_AXIS, 3, false}, // YAW, Xrotate
 
   // These are hacks to make different simulators work that do not support buttons!
-  Joystick.Yrotate(map(ch_latency[0][4], _min, _max, 0, 65535));   // AUX1 for TWGO
-  Joystick.Zrotate(map(ch_latency[0][5], _min, _max, 0, 65535));   // AUX2 for TWGO
-  Joystick.slider(1, map(ch_latency[0][6], _min, _max, 0, 65535)); // FPV.SkyDive only sees one slider
-  Joystick.hat(1, hats[map(ch_latency[0][7], _min, _max, 0, 2)]);  // FPV.SkyDive knows about the hat!
+  {4, MAP_AXIS, 4, false},   // AUX1 for TWGO, Yrotate
+  {5, MAP_AXIS, 5, false},   // AUX2 for TWGO, Zrotate
+  {6, MAP_SLIDER, 1, false}, // FPV.SkyDive only sees one slider
+  {7, MAP_HAT, 1, false},    // FPV.SkyDive knows about the hat!
+
+  // The rest are three position switches, three buttons each
+  {4, MAP_BUTTONS, 1, false},
+  {5, MAP_BUTTONS, 4, false},
+  {6, MAP_BUTTONS, 7, false},
+  {7, MAP_BUTTONS, 10, false},
+  {8, MAP_BUTTONS, 13, false},
+  {9, MAP_BUTTONS, 16, false},
+  {10, MAP_BUTTONS, 19, false},
+  {11, MAP_BUTTONS, 22, false},
+  {12, MAP_BUTTONS, 25, false},
+  {13, MAP_BUTTONS, 28, false},
+  {14, MAP_BUTTONS, 31, false},
+  {15, MAP_BUTTONS, 34, false},
+};
+
+constexpr ChannelTables crsfTables(US_MIN, US_MAX, true);
+constexpr ChannelTables sbusTables(STARTPOINT, ENDPOINT, false);
+ChannelMapper mapper(channelMap, sizeof(channelMap) / sizeof(channelMap[0]), hats);
+
+// Raw 11-bit channels to the report, _frameUs is when the frame reached us (or left the emulator)
+void mapChannels(const uint16_t *raw, uint8_t _source, uint32_t _frameUs)
+{
+  static uint8_t lastSource = INPUT_NONE;
+
+  mapper.apply(raw, _source == INPUT_SBUS ? sbusTables : crsfTables);
+  reportState.pending = true;
+  blackbox.onChannels(raw, _source, _frameUs);
+
+  // Another source has its own frame clock
+  if (_source != lastSource)
+  {
+    lastSource = _source;
+    interp.reset();
+  }
+  interp.onFrame(mapper.getSticks(), _frameUs);
 }
 
-void setButton(uint8_t _button, uint16_t _min = 1000, uint16_t _max = 2000)
+// Channels from whichever source the arbiter picked go through the same pipeline,
+// false if the emulator holds on to them for now
+bool applyChannels(const uint16_t *raw, uint8_t _source, uint32_t _frameUs)
 {
-  for (uint8_t _position = 0; _position < 3; _position++)
+  if (emulator.isActive())
   {
-    Joystick.button(_button * 3 + _position + 1, (uint8_t)map(ch_latency[0][4 + _button], _min, _max, 0, 2) == _position ? true : false);
+    emulator.push(raw, _source, _frameUs, micros());
+    return false;
   }
+  mapChannels(raw, _source, _frameUs);
+  return true;
 }
 
-void setButtons(uint16_t _min = 1000, uint16_t _max = 2000)
+void packetChannels(uint8_t _receiver)
 {
-  for (uint8_t _button = 0; _button < (CHANNELS - 4); _button++)
+  uint32_t dispatch = micros();
+  CrsfSerial &_crsf = *receivers[_receiver];
+  linkMonitors[_receiver].onRcFrame(millis());
+
+  // Telemetry goes out in the gap after this frame, once the report is sent
+  if (_receiver == 0)
+    telemetry.onRcFrame();
+
+  // Newest frame of either receiver, then whether CRSF drives the output at all
+  if (!diversity.onFrame(_receiver) || !arbiter.onFrame(INPUT_CRSF, FRAME_OK, millis()))
+    return;
+
+  uint16_t _raw[CHANNELS];
+  for (uint8_t _channel = 0; _channel < CHANNELS; _channel++)
   {
-    setButton(_button, _min, _max);
+    _raw[_channel] = _crsf.getChannelRaw(_channel + 1);
   }
+  // The latency stages measure this device, frames the emulator delays are in "get emu"
+  if (!applyChannels(_raw, INPUT_CRSF, _crsf.getChannelsUs()))
+    return;
+
+  latencyState.rx = _crsf.getFrameStartUs();
+  latencyState.crc = _crsf.getFrameValidUs();
+  latencyState.dispatch = dispatch;
+  latencyState.mapped = micros();
+  latencyState.pending = true;
 }
 
-void packetChannels()
+void sbusChannels()
 {
+  uint8_t status = sbus.isFailsafe() ? FRAME_FAILSAFE : sbus.isLostFrame() ? FRAME_LOST : FRAME_OK;
+  if (!arbiter.onFrame(INPUT_SBUS, status, millis()))
+    return;
+
+  uint16_t _raw[CHANNELS];
   for (uint8_t _channel = 0; _channel < CHANNELS; _channel++)
   {
-    ch_latency[LATENCY][_channel] = crsf.getChannel(_channel + 1);
+    _raw[_channel] = sbus.getChannelRaw(_channel + 1);
   }
+  applyChannels(_raw, INPUT_SBUS, micros());
+  // The latency stages are CRSF timestamps
+  latencyState.pending = false;
+}
 
-  setSticks(US_MIN, US_MAX);
-  setButtons(US_MIN, US_MAX);
+void recordLatency(uint32_t sent)
+{
+  LatencyHistogram *stages = latencyState.stages;
+  stages[LAT_RX_CRC].add(latencyState.crc - latencyState.rx);
+  stages[LAT_CRC_DISPATCH].add(latencyState.dispatch - latencyState.crc);
+  stages[LAT_DISPATCH_MAPPED].add(latencyState.mapped - latencyState.dispatch);
+  stages[LAT_MAPPED_USB].add(sent - latencyState.mapped);
+  stages[LAT_RX_USB].add(sent - latencyState.rx);
+  latencyState.pending = false;
+}
 
-  crsf.queuePacket(CRSF_SYNC_BYTE, CRSF_FRAMETYPE_BATTERY_SENSOR, &crsfbatt, sizeof(crsfbatt));
+// Sticks for the report about to go out, true if the interpolator moved them
+bool renderSticks()
+{
+  uint16_t _sticks[StickInterpolator::AXES];
+  if (!interp.render(micros(), _sticks))
+    return false;
+  mapper.setSticks(_sticks);
+  return true;
 }
 
-void induceLatency()
+void sendReport()
 {
-  for (uint8_t _bufs = 0; _bufs < LATENCY; _bufs++)
+  if (reportState.mode == REPORT_EVENT)
   {
-    memcpy(ch_latency[_bufs], ch_latency[_bufs + 1], sizeof(uint16_t) * CHANNELS);
+    if (micros() - reportState.lastSentUs < reportState.spacing)
+      return;
+    // Interpolated sticks move between frames, so every report slot can have something new
+    if (!renderSticks() && !reportState.pending)
+      return;
+
+    reportState.pending = false;
+    if (memcmp(reportState.lastReport, usb_joystick_data, sizeof(reportState.lastReport)) == 0)
+    {
+      // Nothing new reaches the host, so there is no latency to measure either
+      reportState.suppressed++;
+      latencyState.pending = false;
+      diversity.onReportSent();
+      return;
+    }
+    memcpy(reportState.lastReport, usb_joystick_data, sizeof(reportState.lastReport));
   }
+  else if (micros() - reportState.lastSentUs < reportState.interval)
+    return;
+  else
+    renderSticks();
+
+  reportState.lastSentUs = micros();
+  reportState.sent++;
+
+  Joystick.send_now();
+  diversity.onReportSent();
+
+  if (latencyState.pending)
+    recordLatency(micros());
+}
+
+void streamCapture()
+{
+  // Bulk send whatever the capture encoded, never more than USB takes without blocking
+  size_t len;
+  const uint8_t *data = capture.peek(&len);
+  int room = Serial.availableForWrite();
+  if (len == 0 || room <= 0)
+    return;
+
+  len = min(len, (size_t)room);
+  Serial.write(data, len);
+  capture.consume(len);
+}
+
+void taskEmulator()
+{
+  // Every frame that is due, in order, so buttons see each one. For the frame clock the frame
+  // arrived later by what the emulator added.
+  const LinkEmulator::Frame *_frame;
+  while ((_frame = emulator.pop(micros())) != NULL)
+    mapChannels(_frame->raw, _frame->source, micros() - (_frame->pushedUs - _frame->arrivalUs));
+}
+
+void streamBlackbox()
+{
+  size_t len;
+  const uint8_t *data = blackbox.peek(&len);
+  int room = Serial.availableForWrite();
+  if (len == 0 || room <= 0)
+    return;
+
+  len = min(len, (size_t)room);
+  Serial.write(data, len);
+  blackbox.consume(len);
 }
 
 void linkUp()
@@ -109,14 +377,374 @@ void linkUp()
 
 void linkDown()
 {
-  digitalWrite(LED_BUILTIN, LOW);
+  // The LED stays on as long as one receiver is up
+  digitalWrite(LED_BUILTIN, diversity.isAnyLinkUp() ? HIGH : LOW);
+}
+
+// Events of both receivers and SBUS, bound at compile time and inlined into the parsers
+struct crsfEvents : CrsfHandler
+{
+  uint8_t receiver;
+
+  crsfEvents(uint8_t _receiver) : receiver(_receiver) {}
+  void onLinkUp(CrsfSerial &)
+  {
+    blackbox.onEvent(BLACKBOX_LINK_UP, receiver, micros());
+    linkUp();
+  }
+  void onLinkDown(CrsfSerial &)
+  {
+    blackbox.onEvent(BLACKBOX_LINK_DOWN, receiver, micros());
+    linkDown();
+  }
+  void onPacketChannels(CrsfSerial &) { packetChannels(receiver); }
+  void onPacketLinkStatistics(CrsfSerial &, const crsfLinkStatistics_t *_link)
+  {
+    linkMonitors[receiver].onLinkStatistics(_link, millis());
+    blackbox.onLinkStatistics(receiver, _link, micros());
+  }
+  void onFrame(CrsfSerial &_crsf, const uint8_t *_frame, uint8_t _len)
+  {
+    if (!forwarder.active())
+      return;
+    // One stream for the host, from the receiver diversity picked (the first one until it has)
+    uint8_t _selected = diversity.getSelected();
+    if (receiver == (_selected == CrsfDiversity::NO_RECEIVER ? 0 : _selected))
+      forwarder.onFrame(_frame, _len, _crsf.getFrameStartUs());
+  }
+} crsfEvents[] = {0, 1};
+
+struct sbusEvents : SbusHandler
+{
+  void onPacketChannels(SbusSerial &) { sbusChannels(); }
+} sbusEvents;
+
+void checkSerialIn();
+
+// Main loop tasks, see taskTable
+void taskRx()
+{
+  crsf.loop(crsfEvents[0]);
+#if DIVERSITY
+  crsf2.loop(crsfEvents[1]);
+#endif
+  // SBUS is parsed all the time, the arbiter decides whose frames reach the joystick
+  if (!crsf.getPassthroughMode())
+    sbus.loop(sbusEvents);
+  forwarder.flush();
+}
+
+void taskHid()
+{
+  if (!crsf.getPassthroughMode())
+    sendReport();
+}
+
+void taskSource()
+{
+  for (uint8_t _idx = 0; _idx < sizeof(receivers) / sizeof(receivers[0]); _idx++)
+    linkMonitors[_idx].update(millis());
+  if (!crsf.getPassthroughMode())
+    arbiter.loop(millis());
+
+  static uint8_t lastActive = INPUT_NONE;
+  if (arbiter.getActive() != lastActive)
+  {
+    lastActive = arbiter.getActive();
+    blackbox.onEvent(BLACKBOX_SOURCE, lastActive, micros());
+  }
+}
+
+void taskTelemetry()
+{
+  if (!crsf.getPassthroughMode())
+    telemetry.loop();
 }
 
-void crsfShiftyByte(uint8_t _byte)
+void taskSerial()
 {
-  // Serial data returned from the receiver, status messages from ELRS and the ESP in passthrough
+  if (!crsf.getPassthroughMode())
+  {
+    streamCapture();
+    if (blackbox.dumping())
+    {
+      // Nothing but the dump until it is out
+      streamBlackbox();
+      return;
+    }
+  }
+  checkSerialIn();
+}
+
+void taskLed()
+{
+  // Blinks in passthrough, otherwise on as long as a receiver is up
   if (crsf.getPassthroughMode())
-    Serial.write(_byte);
+    digitalWrite(LED_BUILTIN, millis() % 1000 < 500 ? HIGH : LOW);
+  else
+    digitalWrite(LED_BUILTIN, diversity.isAnyLinkUp() ? HIGH : LOW);
+}
+
+// Highest priority first, every pass tasks (period 0) poll and return right away when idle.
+// The deadline is how late a task may start, for every pass tasks the longest gap between
+// two runs, see "get tasks"
+const SchedulerTask taskTable[] = {
+  {"rx", taskRx, 0, 500},
+  {"emulator", taskEmulator, 0, USB_FRAME_US},
+  {"hid", taskHid, 0, USB_FRAME_US},
+  {"source", taskSource, 1000, 5000},
+  {"telemetry", taskTelemetry, 0, 2000},
+  {"serial", taskSerial, 0, 10000},
+  {"led", taskLed, 10000, 50000},
+};
+Scheduler scheduler(taskTable, sizeof(taskTable) / sizeof(taskTable[0]));
+
+static void printTasks()
+{
+  Serial.printf("task        period deadline       runs   misses deferred late max  exec last    max   mean (us)\r\n");
+  for (uint8_t _idx = 0; _idx < scheduler.getCount(); _idx++)
+  {
+    const SchedulerTask &_task = scheduler.getTask(_idx);
+    const Scheduler::Stats &_stats = scheduler.getStats(_idx);
+    Serial.printf("%-10s %7lu %8lu %10lu %8lu %8lu %8lu %10lu %6lu %6lu\r\n", _task.name, (unsigned long)_task.periodUs,
+                  (unsigned long)_task.deadlineUs, (unsigned long)_stats.runs, (unsigned long)_stats.misses,
+                  (unsigned long)_stats.deferred, (unsigned long)_stats.maxLateUs, (unsigned long)_stats.lastExecUs,
+                  (unsigned long)_stats.maxExecUs, (unsigned long)(_stats.runs ? _stats.totalExecUs / _stats.runs : 0));
+  }
+  Serial.printf("passes = %lu\r\n\r\n", (unsigned long)scheduler.getPasses());
+}
+
+static void printLatency()
+{
+  Serial.println("stage               count    min    p50    p99    max (us)");
+  for (uint8_t _stage = 0; _stage < LAT_STAGES; _stage++)
+  {
+    const LatencyHistogram &_hist = latencyState.stages[_stage];
+    Serial.printf("%-16s %8lu %6lu %6lu %6lu %6lu\r\n", latencyNames[_stage], (unsigned long)_hist.count(),
+                  (unsigned long)_hist.minimum(), (unsigned long)_hist.percentile(50),
+                  (unsigned long)_hist.percentile(99), (unsigned long)_hist.maximum());
+  }
+  Serial.println();
+}
+
+static void printTelemetry()
+{
+  Serial.printf("from host: frames = %lu, crc errors = %lu, rejected = %lu, timeouts = %lu\r\n",
+                (unsigned long)telemetryFeed.getFrames(), (unsigned long)telemetryFeed.getCrcErrors(),
+                (unsigned long)telemetryFeed.getRejected(), (unsigned long)telemetryFeed.getTimeouts());
+  Serial.printf("queue = %u bytes, drops = %lu, busy slots = %lu, idle slots = %lu\r\n", crsf.getTxQueueDepth(),
+                (unsigned long)crsf.getTxDrops(), (unsigned long)telemetry.getBusy(), (unsigned long)telemetry.getIdle());
+  for (uint8_t _idx = 0; _idx < telemetry.getSlotCount(); _idx++)
+  {
+    const CrsfTelemetry::Slot &_slot = telemetry.getSlot(_idx);
+    Serial.printf("type 0x%02X prio %u every %u ms: sent %lu, coalesced %lu\r\n", _slot.type, _slot.priority,
+                  _slot.intervalMs, (unsigned long)_slot.sent, (unsigned long)_slot.coalesced);
+  }
+  Serial.println();
+}
+
+static void printCurves()
+{
+  for (uint8_t _axis = 0; _axis < ChannelMapper::CURVE_AXES; _axis++)
+  {
+    const CurveConfig &_config = mapper.getCurve(_axis).getConfig();
+    Serial.printf("curve %u: center = %d, deadband = %u, expo = %u, rate = %u\r\n", _axis, _config.center,
+                  _config.deadband, _config.expo, _config.rate);
+  }
+  Serial.println();
+}
+
+// The number of a "set" command, false if it isn't one. Like the emulator setters, a value outside
+// low..high is clamped rather than refused.
+static bool parseClamped(const char *text, uint32_t low, uint32_t high, uint32_t &value)
+{
+  char *_end;
+  unsigned long _value = strtoul(text, &_end, 10);
+  if (_end == text || *_end != '\0' || *text == '-')
+    return false;
+  value = _value < low ? low : _value > high ? high : _value;
+  return true;
+}
+
+// "<axis> center|deadband|expo|rate <percent>", the axis table is rebuilt right away.
+// A value outside the setting's range is refused, not clamped.
+static bool setCurve(const char *args)
+{
+  // In the order of CurveConfig
+  static const char *const _names[] = {"center", "deadband", "expo", "rate"};
+  static const int16_t _ranges[][2] = {{-25, 25}, {0, 50}, {0, 100}, {0, 200}};
+
+  char *_end;
+  long _axis = strtol(args, &_end, 10);
+  if (_end == args || *_end != ' ' || _axis < 0 || _axis >= ChannelMapper::CURVE_AXES)
+    return false;
+
+  const char *_name = _end + 1;
+  const char *_value = strchr(_name, ' ');
+  if (!_value)
+    return false;
+  size_t _len = _value - _name;
+  uint8_t _field;
+  for (_field = 0; _field < 4; _field++)
+    if (strlen(_names[_field]) == _len && strncmp(_name, _names[_field], _len) == 0)
+      break;
+  if (_field == 4)
+    return false;
+  long _percent = strtol(_value + 1, &_end, 10);
+  if (_end == _value + 1 || *_end != '\0' || _percent < _ranges[_field][0] || _percent > _ranges[_field][1])
+    return false;
+
+  CurveConfig _config = mapper.getCurve(_axis).getConfig();
+  if (_field == 0)
+    _config.center = _percent;
+  else if (_field == 1)
+    _config.deadband = _percent;
+  else if (_field == 2)
+    _config.expo = _percent;
+  else
+    _config.rate = _percent;
+
+  mapper.setCurve(_axis, _config);
+  return true;
+}
+
+static void printSource()
+{
+  uint8_t _active = arbiter.getActive();
+  Serial.printf("source = %s, switches = %lu, timeout = %u ms, hold = %u ms\r\n",
+                _active == INPUT_NONE ? "NONE" : sourceNames[_active], (unsigned long)arbiter.getSwitches(),
+                arbiter.getTimeout(), arbiter.getHold());
+  for (uint8_t _idx = 0; _idx < INPUT_SOURCES; _idx++)
+  {
+    const InputArbiter::Source &_source = arbiter.getSource(_idx);
+    Serial.printf("%s: %s, %u Hz, frames %lu, lost %lu, failsafe %lu, last ok %lu ms ago\r\n", sourceNames[_idx],
+                  _source.healthy ? "healthy" : "down", _source.rate, (unsigned long)_source.frames,
+                  (unsigned long)_source.lost, (unsigned long)_source.failsafes,
+                  (unsigned long)(_source.frames ? millis() - _source.lastOkMs : 0));
+  }
+  Serial.println();
+}
+
+static void printReceivers()
+{
+  uint8_t _selected = diversity.getSelected();
+  Serial.printf("selected = %d, same packet within %lu us\r\n", _selected == CrsfDiversity::NO_RECEIVER ? -1 : _selected,
+                (unsigned long)diversity.getWindowUs());
+  for (uint8_t _idx = 0; _idx < diversity.getCount(); _idx++)
+  {
+    const CrsfDiversity::Receiver &_rx = diversity.getReceiver(_idx);
+    const crsfLinkStatistics_t *_link = _rx.crsf->getLinkStatistics();
+    Serial.printf("rx %u: link %s, LQ %u, RSSI -%u/-%u dBm, frames %lu, forwarded %lu, tie wins %lu, duplicates %lu\r\n", _idx,
+                  _rx.crsf->isLinkUp() ? "UP" : "DOWN", _link->uplink_Link_quality, _link->uplink_RSSI_1,
+                  _link->uplink_RSSI_2, (unsigned long)_rx.frames, (unsigned long)_rx.forwarded,
+                  (unsigned long)_rx.tieWins, (unsigned long)_rx.duplicates);
+  }
+  Serial.println();
+}
+
+static void printStats()
+{
+  static const char *const _events[CRSF_EVENT_COUNT] = {"other", "rc", "link", "ping", "read", "write", "cmd"};
+  uint32_t _now = millis();
+  for (uint8_t _idx = 0; _idx < sizeof(receivers) / sizeof(receivers[0]); _idx++)
+  {
+    const CrsfParserStats &_stats = receivers[_idx]->getStats();
+    Serial.printf("rx %u: crc %lu, length %lu, resync %lu, timeout %lu, gap %lu, up %lu, down %lu\r\n", _idx,
+                  (unsigned long)_stats.crcErrors, (unsigned long)_stats.lengthErrors,
+                  (unsigned long)_stats.resyncBytes, (unsigned long)_stats.timeouts,
+                  (unsigned long)_stats.gapDrops, (unsigned long)_stats.linkUps, (unsigned long)_stats.linkDowns);
+    Serial.print("  frames");
+    for (uint8_t _event = 0; _event < CRSF_EVENT_COUNT; _event++)
+      Serial.printf(" %s %lu", _events[_event], (unsigned long)_stats.frames[_event]);
+    Serial.println();
+
+    // Min/mean/max of the last RollingWindow::BLOCKS seconds
+    CrsfLinkMonitor &_monitor = linkMonitors[_idx];
+    _monitor.update(_now);
+    const RollingWindow &_rate = _monitor.getRate();
+    Serial.printf("  %-6s %5d %5d %5d\r\n", "rate", _rate.minimum(), _rate.mean(), _rate.maximum());
+    for (uint8_t _field = 0; _field < CrsfLinkMonitor::LINK_FIELDS; _field++)
+    {
+      const RollingWindow &_window = _monitor.getField(_field);
+      if (_window.count() == 0)
+        continue;
+      Serial.printf("  %-6s %5d %5d %5d\r\n", CrsfLinkMonitor::FIELD_NAMES[_field], _window.minimum(), _window.mean(),
+                    _window.maximum());
+    }
+  }
+  Serial.println();
+}
+
+static void printRate()
+{
+  const FrameClock &_clock = interp.getClock();
+  uint32_t _period = _clock.getPeriodUs();
+  Serial.printf("rate = %lu Hz, period = %lu us, jitter = %lu us, clock = %s, missed = %lu, restarts = %lu\r\n",
+                _period ? 1000000UL / _period : 0UL, (unsigned long)_period, (unsigned long)_clock.getJitterUs(),
+                _clock.isLocked() ? "locked" : "unlocked", (unsigned long)_clock.getMissed(),
+                (unsigned long)_clock.getRestarts());
+  Serial.printf("interp = %s, lead = %lu%%, rendered = %lu, held = %lu, limited = %lu\r\n\r\n",
+                StickInterpolator::MODE_NAMES[interp.getMode()], ((unsigned long)interp.getMaxLead() * 100 + AXIS_MAX / 2) / AXIS_MAX,
+                (unsigned long)interp.getRendered(), (unsigned long)interp.getHeld(), (unsigned long)interp.getLimited());
+}
+
+static bool setInterp(const char *_mode)
+{
+  for (uint8_t _idx = 0; _idx < StickInterpolator::INTERP_MODES; _idx++)
+    if (strcmp(_mode, StickInterpolator::MODE_NAMES[_idx]) == 0)
+    {
+      interp.setMode(_idx);
+      return true;
+    }
+  return false;
+}
+
+static void printEmu()
+{
+  const LatencyHistogram &_added = emulator.getAdded();
+  Serial.printf("emu = %s, delay = %lu us, jitter = %lu us %s, drop = %u%% in bursts of %u, decimate = %u\r\n",
+                emulator.isActive() ? "ON" : "OFF", (unsigned long)emulator.getDelay(),
+                (unsigned long)emulator.getJitter(), LinkEmulator::JITTER_NAMES[emulator.getDistribution()],
+                emulator.getDrop(), emulator.getBurst(), emulator.getDecimate());
+  Serial.printf("limit = %lu us at a frame every %lu us, capped = %lu\r\n", (unsigned long)emulator.getLimit(),
+                (unsigned long)emulator.getFramePeriod(), (unsigned long)emulator.getCapped());
+  Serial.printf("queued = %u, passed = %lu, dropped = %lu, decimated = %lu, overflows = %lu\r\n", emulator.getQueued(),
+                (unsigned long)emulator.getPassed(), (unsigned long)emulator.getDropped(),
+                (unsigned long)emulator.getDecimated(), (unsigned long)emulator.getOverflows());
+  Serial.printf("added min = %lu, p50 = %lu, p99 = %lu, max = %lu us\r\n\r\n", (unsigned long)_added.minimum(),
+                (unsigned long)_added.percentile(50), (unsigned long)_added.percentile(99),
+                (unsigned long)_added.maximum());
+}
+
+// The ring only holds so many frames, frames leave at the limit rather than being lost
+static void warnEmuLimit()
+{
+  Serial.printf("warning: the emulator only holds %lu us at a frame every %lu us, frames leave after that\r\n\r\n",
+                (unsigned long)emulator.getLimit(), (unsigned long)emulator.getFramePeriod());
+}
+
+static bool setEmuDistribution(const char *_name)
+{
+  for (uint8_t _idx = 0; _idx < LinkEmulator::JITTERS; _idx++)
+    if (strcmp(_name, LinkEmulator::JITTER_NAMES[_idx]) == 0)
+      return emulator.setDistribution(_idx);
+  return false;
+}
+
+static void printBaud()
+{
+  for (uint8_t _idx = 0; _idx < sizeof(receivers) / sizeof(receivers[0]); _idx++)
+  {
+    const CrsfSerial &_crsf = *receivers[_idx];
+    const CrsfBaudProbe &_probe = _crsf.getBaudProbe();
+    if (!_crsf.isAutoBaud())
+      Serial.printf("rx %u: baud = %lu (fixed)\r\n", _idx, (unsigned long)_crsf.getBaud());
+    else
+      Serial.printf("rx %u: baud = %lu (%s), locks = %lu, switches = %lu\r\n", _idx, (unsigned long)_crsf.getBaud(),
+                    _probe.isLocked() ? "locked" : "searching", (unsigned long)_probe.getLocks(),
+                    (unsigned long)_probe.getSwitches());
+  }
+  Serial.println();
 }
 
 static bool handleSerialCommand(char *cmd)
@@ -141,6 +769,239 @@ static bool handleSerialCommand(char *cmd)
   else if (strcmp(cmd, "get serialrx_halfduplex") == 0)
     Serial.println("serialrx_halfduplex = OFF\r\n");
 
+  else if (strcmp(cmd, "get report") == 0)
+    Serial.printf("report = %s, interval = %lu us, spacing = %lu us, sent = %lu, suppressed = %lu\r\n\r\n",
+                  reportState.mode == REPORT_EVENT ? "EVENT" : "POLL", (unsigned long)reportState.interval,
+                  (unsigned long)reportState.spacing,
+                  (unsigned long)reportState.sent, (unsigned long)reportState.suppressed);
+
+  else if (strcmp(cmd, "get layout") == 0)
+    Serial.printf("layout = %s\r\n\r\n", layoutNames[mapper.getLayout()]);
+
+  else if (strncmp(cmd, "set layout ", 11) == 0)
+  {
+    uint8_t _layout = 0;
+    while (_layout < LAYOUTS && strcmp(cmd + 11, layoutNames[_layout]) != 0)
+      _layout++;
+    if (!mapper.setLayout(_layout))
+      Serial.println("usage: set layout mapped|channels (channels needs the 64 byte report)\r\n");
+  }
+
+  else if (strcmp(cmd, "get tasks") == 0)
+    printTasks();
+
+  else if (strcmp(cmd, "reset tasks") == 0)
+    scheduler.resetStats();
+
+  else if (strcmp(cmd, "get latency") == 0)
+    printLatency();
+
+  else if (strcmp(cmd, "reset latency") == 0)
+  {
+    for (uint8_t _stage = 0; _stage < LAT_STAGES; _stage++)
+      latencyState.stages[_stage].reset();
+  }
+
+  else if (strcmp(cmd, "get telemetry") == 0)
+    printTelemetry();
+
+  else if (strcmp(cmd, "capture start") == 0 && forwarder.active())
+    Serial.println("forwarding, \"forward stop\" first\r\n");
+
+  else if (strcmp(cmd, "capture start") == 0)
+  {
+    // Binary from here on, no echo and no prompt until "capture stop"
+    crsfState.serialEcho = false;
+    capture.start(micros());
+    crsf.setCapture(&capture);
+#if DIVERSITY
+    crsf2.setCapture(&capture, CAPTURE_SOURCE_CRSF2);
+#endif
+    sbus.setCapture(&capture);
+    return true;
+  }
+
+  else if (strcmp(cmd, "capture stop") == 0)
+  {
+    crsf.setCapture(NULL);
+#if DIVERSITY
+    crsf2.setCapture(NULL);
+#endif
+    sbus.setCapture(NULL);
+    capture.stop();
+    return true;
+  }
+
+  else if ((strcmp(cmd, "forward start") == 0 || strcmp(cmd, "forward start ts") == 0) && capture.active())
+    Serial.println("capture is running, \"capture stop\" first\r\n");
+
+  else if (strcmp(cmd, "forward start") == 0 || strcmp(cmd, "forward start ts") == 0)
+  {
+    // Binary from here on like a capture, until "forward stop"
+    crsfState.serialEcho = false;
+    forwarder.setMode(cmd[13] ? CrsfForwarder::FORWARD_TIMESTAMPED : CrsfForwarder::FORWARD_RAW);
+    return true;
+  }
+
+  else if (strcmp(cmd, "forward stop") == 0)
+  {
+    forwarder.setMode(CrsfForwarder::FORWARD_OFF);
+    return true;
+  }
+
+  else if (strcmp(cmd, "get forward") == 0)
+    Serial.printf("forward = %s, frames = %lu, bytes = %lu, drops = %lu, flushes = %lu\r\n\r\n",
+                  forwarder.active() ? "ON" : "OFF", (unsigned long)forwarder.getFrames(),
+                  (unsigned long)forwarder.getBytes(), (unsigned long)forwarder.getDrops(),
+                  (unsigned long)forwarder.getFlushes());
+
+  else if (strcmp(cmd, "blackbox dump") == 0 && (capture.active() || forwarder.active()))
+    Serial.println("capture or forward is running, stop it first\r\n");
+
+  else if (strcmp(cmd, "blackbox dump") == 0)
+  {
+    // Binary, it ends when the whole log is out
+    crsfState.serialEcho = false;
+    blackbox.startDump();
+    return true;
+  }
+
+  else if (strcmp(cmd, "get blackbox") == 0)
+    Serial.printf("blackbox = %u of %u bytes, %lu ms, frames = %lu (%lu repeats), decimated = %lu, keys = %lu, "
+                  "dropped segments = %lu, skipped = %lu, encode mean = %lu ns, max = %lu us\r\n\r\n",
+                  blackbox.used(), Blackbox::BUF_SIZE, (unsigned long)blackbox.spanUs() / 1000,
+                  (unsigned long)blackbox.getFrames(), (unsigned long)blackbox.getRepeats(),
+                  (unsigned long)blackbox.getDecimated(), (unsigned long)blackbox.getKeys(),
+                  (unsigned long)blackbox.getDroppedSegments(), (unsigned long)blackbox.getSkipped(),
+                  (unsigned long)blackbox.getEncodeMeanNs(), (unsigned long)blackbox.getEncodeMaxUs());
+
+  else if (strcmp(cmd, "reset blackbox") == 0)
+    blackbox.reset();
+
+  else if (strcmp(cmd, "get capture") == 0)
+    Serial.printf("capture = %s, bytes = %lu, lost = %lu\r\n\r\n", capture.active() ? "ON" : "OFF",
+                  (unsigned long)capture.bytes(), (unsigned long)capture.lost());
+
+  else if (strcmp(cmd, "set report poll") == 0)
+    reportState.mode = REPORT_POLL;
+
+  else if (strcmp(cmd, "set report event") == 0)
+    reportState.mode = REPORT_EVENT;
+
+  else if (strncmp(cmd, "set report_spacing ", 19) == 0)
+  {
+    if (!parseClamped(cmd + 19, USB_FRAME_US, 100000, reportState.spacing))
+      Serial.println("usage: set report_spacing <us>\r\n");
+  }
+
+  else if (strncmp(cmd, "set report_interval ", 20) == 0)
+  {
+    if (!parseClamped(cmd + 20, USB_FRAME_US, 100000, reportState.interval))
+      Serial.println("usage: set report_interval <us>\r\n");
+  }
+
+  else if (strcmp(cmd, "get receivers") == 0)
+    printReceivers();
+
+  else if (strcmp(cmd, "get rate") == 0)
+    printRate();
+
+  else if (strncmp(cmd, "set interp ", 11) == 0)
+  {
+    if (!setInterp(cmd + 11))
+      Serial.println("usage: set interp off|interpolate|extrapolate\r\n");
+  }
+
+  else if (strncmp(cmd, "set interp_lead ", 16) == 0)
+    interp.setMaxLead((uint32_t)AXIS_MAX * min(max(atoi(cmd + 16), 0), 100) / 100);
+
+  else if (strcmp(cmd, "get emu") == 0)
+    printEmu();
+
+  else if (strcmp(cmd, "reset emu") == 0)
+    emulator.resetStats();
+
+  else if (strcmp(cmd, "set emu off") == 0)
+    emulator.off();
+
+  else if (strncmp(cmd, "set emu_delay ", 14) == 0)
+  {
+    if (!emulator.setDelay(strtoul(cmd + 14, NULL, 10)))
+      warnEmuLimit();
+  }
+
+  else if (strncmp(cmd, "set emu_jitter ", 15) == 0)
+  {
+    if (!emulator.setJitter(strtoul(cmd + 15, NULL, 10)))
+      warnEmuLimit();
+  }
+
+  else if (strncmp(cmd, "set emu_dist ", 13) == 0)
+  {
+    if (!setEmuDistribution(cmd + 13))
+      Serial.println("usage: set emu_dist uniform|normal|exponential\r\n");
+  }
+
+  else if (strncmp(cmd, "set emu_drop ", 13) == 0)
+    emulator.setDrop(min(max(atoi(cmd + 13), 0), 100));
+
+  else if (strncmp(cmd, "set emu_burst ", 14) == 0)
+    emulator.setBurst(min(max(atoi(cmd + 14), 1), 255));
+
+  else if (strncmp(cmd, "set emu_decimate ", 17) == 0)
+    emulator.setDecimate(min(max(atoi(cmd + 17), 1), 255));
+
+  else if (strcmp(cmd, "get baud") == 0)
+    printBaud();
+
+  else if (strcmp(cmd, "get stats") == 0)
+    printStats();
+
+  else if (strcmp(cmd, "reset stats") == 0)
+  {
+    for (uint8_t _idx = 0; _idx < sizeof(receivers) / sizeof(receivers[0]); _idx++)
+    {
+      receivers[_idx]->resetStats();
+      linkMonitors[_idx].reset(millis());
+    }
+  }
+
+  else if (strcmp(cmd, "get source") == 0)
+    printSource();
+
+  else if (strncmp(cmd, "set source_timeout ", 19) == 0)
+  {
+    uint32_t _ms;
+    if (parseClamped(cmd + 19, 20, 5000, _ms))
+      arbiter.setTimeout(_ms);
+    else
+      Serial.println("usage: set source_timeout <ms>\r\n");
+  }
+
+  else if (strncmp(cmd, "set source_hold ", 16) == 0)
+  {
+    uint32_t _ms;
+    if (parseClamped(cmd + 16, 0, 60000, _ms))
+      arbiter.setHold(_ms);
+    else
+      Serial.println("usage: set source_hold <ms>\r\n");
+  }
+
+  else if (strcmp(cmd, "get curve") == 0)
+    printCurves();
+
+  else if (strncmp(cmd, "set curve ", 10) == 0)
+  {
+    if (!setCurve(cmd + 10))
+      Serial.println("usage: set curve <0-3> center <-25..25>|deadband <0..50>|expo <0..100>|rate <0..200>\r\n");
+  }
+
+  else if (strcmp(cmd, "get passthrough") == 0)
+    Serial.printf("to uart = %lu, to usb = %lu, uart stalls = %lu, usb stalls = %lu, overruns = %lu, rx high water = %u\r\n\r\n",
+                  (unsigned long)bridge.getToUart(), (unsigned long)bridge.getToUsb(),
+                  (unsigned long)bridge.getUartStalls(), (unsigned long)bridge.getUsbStalls(),
+                  (unsigned long)bridge.getOverruns(), bridge.getRxHighWater());
+
   else if (strncmp(cmd, "serialpassthrough 5 ", 20) == 0)
   {
     Serial.println("Passthrough serial 5");
@@ -150,6 +1011,7 @@ static bool handleSerialCommand(char *cmd)
 
     unsigned int baud = atoi(cmd + 20);
     crsf.setPassthroughMode(true, baud);
+    bridge.resetStats();
     crsfState.serialEcho = false;
     return false;
   }
@@ -166,20 +1028,9 @@ static bool handleSerialCommand(char *cmd)
 static void checkSerialInPassthrough()
 {
   static uint32_t lastData = 0;
-  // static bool LED = false;
-  bool gotData = false;
 
-  // Simple data passthrough from in to crsf
-  unsigned int avail;
-  while ((avail = Serial.available()) != 0)
-  {
-    uint8_t buf[16];
-    avail = Serial.readBytes((char *)buf, min(sizeof(buf), avail));
-    crsf.write(buf, avail);
-    // digitalWrite(DPIN_LED, LED);
-    // LED = !LED;
-    gotData = true;
-  }
+  // Bulk copy both ways, the receiver talking back also counts as activity
+  bool gotData = bridge.loop() != 0;
 
   // If longer than X seconds since last data, switch out of passthrough
   if (gotData || !lastData)
@@ -187,9 +1038,6 @@ static void checkSerialInPassthrough()
   else if (millis() - lastData > 10000)
   {
     lastData = 0;
-    // digitalWrite(DPIN_LED, HIGH ^ LED_INVERTED);
-    // delay(250);
-    // digitalWrite(DPIN_LED, LOW ^ LED_INVERTED);
     //crsf.write(rebootcmd, sizeof(rebootcmd));
     crsf.setPassthroughMode(false);
     //crsf.setPassthroughMode(false, 115200);
@@ -198,9 +1046,12 @@ static void checkSerialInPassthrough()
 
 static void checkSerialInNormal()
 {
-  while (Serial.available())
+  // At most one USB packet a pass, a burst from the host is spread over a few passes
+  for (uint8_t _bytes = 0; _bytes < 64 && Serial.available(); _bytes++)
   {
     char c = Serial.read();
+    if (telemetryFeed.feed(c, millis()))
+      continue;
     if (crsfState.serialEcho && c != '\n')
       Serial.write(c);
 
@@ -239,71 +1090,29 @@ void checkSerialIn()
 
 void setup()
 {
-  for (uint16_t _x = 0; _x <= LATENCY; _x++)
-  {
-    for (uint8_t _y = 0; _y < CHANNELS; _y++)
-    {
-      ch_latency[_x][_y] = 0; // pre-allocate the array with zeros
-    }
-  }
-
   pinMode(LED_BUILTIN, OUTPUT); // LED to show if CRSF is active
 
   Serial.begin(115200);
 
   sbus.begin();
+  crsf.getPort().addMemoryForRead(uartRxExtra, sizeof(uartRxExtra));
 
-  crsf.onLinkUp = &linkUp;
-  crsf.onLinkDown = &linkDown;
-  crsf.onShiftyByte = &crsfShiftyByte;
-  crsf.onPacketChannels = &packetChannels;
+  // The rest only goes out once the host sent it
+  telemetry.configure(CRSF_FRAMETYPE_ATTITUDE, 0, 100);
+  telemetry.configure(CRSF_FRAMETYPE_BATTERY_SENSOR, 1, 1000);
+  telemetry.configure(CRSF_FRAMETYPE_GPS, 1, 200);
+  telemetry.configure(CRSF_FRAMETYPE_FLIGHT_MODE, 2, 500);
+  telemetry.setPayload(CRSF_FRAMETYPE_BATTERY_SENSOR, crsfbatt, sizeof(crsfbatt));
 
   // crsf.write(rebootcmd, sizeof(rebootcmd));
   // crsf.setPassthroughMode(false);
 
+  mapper.setLayout(HID_LAYOUT);
+  emulator.setDelay(EMU_DELAY);
   Joystick.useManualSend(true);
 }
 
 void loop()
 {
-  crsf.loop();
-
-  if (crsf.getPassthroughMode())
-  {
-    if (millis() - timing[0] >= 1000)
-    {
-      timing[0] = millis();
-    }
-
-    digitalWrite(LED_BUILTIN, millis() - timing[0] < 500 ? HIGH : LOW);
-  }
-  else
-  {
-    if (!crsf.isLinkUp()) // fallback to SBUS
-    {
-      digitalWrite(LED_BUILTIN, LOW);
-
-      if (sbus.read(&ch_latency[LATENCY][0], &sbusStatus[0], &sbusStatus[1]))
-      {
-        setSticks(STARTPOINT, ENDPOINT);
-        setButtons(STARTPOINT, ENDPOINT);
-      }
-    }
-
-    if (LATENCY > 0 && micros() - timing[1] >= 1000)
-    {
-      timing[1] = micros();
-
-      induceLatency();
-    }
-
-    if (micros() - timing[2] >= (INTERVAL == 0 ? 1 : INTERVAL) * 1000)
-    {
-      timing[2] = micros();
-
-      Joystick.send_now();
-    }
-  }
-
-  checkSerialIn();
-}
\ No newline at end of file
+  scheduler.loop();
+}
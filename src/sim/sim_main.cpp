@@ -0,0 +1,1100 @@
+#if !defined(ARDUINO)
+
+/*
+ * Host simulation of the joystick for the native environment.
+ *
+ * Runs the firmware's setup()/loop() against the virtual clock with a synthetic
+ * CRSF receiver on Serial2, USB serial output goes to stdout. The run exits non-zero when
+ * one of its checks fails, test/test_sim runs it through simMain() and looks at the SimResult.
+ *
+ *   program [options]
+ *     --seconds N   simulated time (default 10)
+ *     --rate HZ     RC packet rate (default 250)
+ *     --baud B      receiver baud rate, sets the byte time on the wire (default 115200), a UART
+ *                   at another rate decodes what its own bit timing makes of the line
+ *     --rebaud B    the receivers switch to baud B halfway through the run, the first one has to
+ *                   lock onto it within LOCK_TIMEOUT_MS plus a search through all rates
+ *     --split PCT   percentage of frames that pause for 20 byte times halfway while the first receiver is
+ *                   locked to the baud rate, without --noise and --rebaud the firmware has to drop exactly those
+ *     --loop US     virtual time per loop() pass (default 5)
+ *     --poll US     the host reads the joystick every US (default 1000, 125 for high speed USB)
+ *     --noise PCT   percentage of frames followed by garbage or hit by a bit flip
+ *     --sbus        also run an SBUS receiver on Serial1 (frame every 14 ms, same sticks)
+ *     --outage MS   CRSF frames stop for the first MS milliseconds of every second
+ *     --rx2 US      second CRSF receiver on Serial3, gets the same packets US later with LQ 90, the
+ *                   firmware (built with DIVERSITY, as the native env is) may forward each packet only once
+ *     --outage2 MS  the second receiver stops for MS milliseconds from the middle of every second
+ *     --blackbox FILE  dump the blackbox to FILE after the run ("blackbox dump") and decode it, the last
+ *                   frame in it has to be the last one that arrived intact, an empty FILE only decodes it
+ *     --feed HZ     the host sends attitude telemetry at HZ (and battery every tenth time) over USB serial
+ *     --cmd TEXT    send a CLI command over USB serial before the run (repeatable)
+ *     --query TEXT  send a CLI command over USB serial after the run (repeatable)
+ *     --record FILE capture the simulated receiver bytes to FILE ("capture start/stop")
+ *     --forward FILE  forward the valid CRSF frames to FILE ("forward start/stop") and check them, an empty
+ *                   FILE only checks them, every byte has to belong to a frame that passes its CRC
+ *     --forward-ts FILE  the same with timestamps ("forward start ts")
+ *     --replay FILE feed a capture back with its original timing instead of the synthetic receiver
+ *     --flash KB    push a KB sized blob through "serialpassthrough" to a receiver that echoes it
+ *     --bench       parser, CRC and response curve benchmarks instead of the simulation
+ */
+
+#include <Sim.h>
+#include <Hal.h>
+#include <CrsfSerial.h>
+#include <SbusSerial.h>
+#include <InputCapture.h>
+#include <Blackbox.h>
+#include <ChannelMap.h>
+#include <SerialBridge.h>
+#include <CrsfDiversity.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+void setup();
+void loop();
+extern SerialBridge bridge;
+extern CrsfSerialPort<HalUart2> crsf;
+extern CrsfDiversity diversity;
+
+struct SimOptions
+{
+    uint32_t seconds = 10;
+    uint32_t rate = 250;
+    uint32_t baud = 115200;
+    uint32_t rebaud = 0;
+    uint32_t loopUs = 5;
+    uint32_t pollUs = 1000;
+    uint32_t noise = 0;
+    uint32_t split = 0;
+    uint32_t flashKb = 0;
+    uint32_t outageMs = 0;
+    int32_t rx2SkewUs = -1;
+    uint32_t outage2Ms = 0;
+    uint32_t feedHz = 0;
+    bool sbus = false;
+    bool bench = false;
+    const char *record = NULL;
+    const char *forward = NULL;
+    bool forwardTs = false;
+    const char *blackbox = NULL;
+    const char *replay = NULL;
+    std::vector<const char *> cmds;
+    std::vector<const char *> queries;
+};
+
+// Small deterministic generator so runs are repeatable
+static uint32_t simRandom()
+{
+    static uint32_t state = 0x12345678;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void appendFrame(std::vector<uint8_t> &out, uint8_t type, const uint8_t *payload, uint8_t len)
+{
+    size_t start = out.size();
+    out.push_back(CRSF_ADDRESS_FLIGHT_CONTROLLER);
+    out.push_back(len + 2);
+    out.push_back(type);
+    out.insert(out.end(), payload, payload + len);
+    out.push_back(CrsfCrc8::calc(&out[start + 2], len + 1));
+}
+
+// Channels at t seconds: sticks move on sines, switches step through their positions
+static void rcChannels(double t, uint16_t *ch)
+{
+    for (unsigned int i = 0; i < 4; ++i)
+        ch[i] = CRSF_CHANNEL_VALUE_MID + (CRSF_CHANNEL_VALUE_SPAN / 2) * sin(t * (i + 1));
+    for (unsigned int i = 4; i < CRSF_NUM_CHANNELS; ++i)
+    {
+        static const uint16_t positions[3] = {CRSF_CHANNEL_VALUE_1000, CRSF_CHANNEL_VALUE_MID, CRSF_CHANNEL_VALUE_2000};
+        ch[i] = positions[((uint32_t)t + i) % 3];
+    }
+}
+
+// 11-bit little endian packing, same for CRSF and SBUS
+static void packChannels(const uint16_t *ch, uint8_t *payload)
+{
+    for (unsigned int i = 0; i < CRSF_NUM_CHANNELS; ++i)
+        for (unsigned int bit = 0; bit < 11; ++bit)
+            if (ch[i] & (1 << bit))
+                payload[(i * 11 + bit) / 8] |= 1 << ((i * 11 + bit) % 8);
+}
+
+// RC frame number n, every 50th is followed by link statistics with uplink LQ lq
+static void appendRcFrame(std::vector<uint8_t> &out, uint32_t n, uint32_t rate, uint8_t lq = 100)
+{
+    uint16_t ch[CRSF_NUM_CHANNELS];
+    rcChannels((double)n / rate, ch);
+
+    uint8_t payload[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE] = {0};
+    packChannels(ch, payload);
+    appendFrame(out, CRSF_FRAMETYPE_RC_CHANNELS_PACKED, payload, sizeof(payload));
+
+    if (n % 50 == 0)
+    {
+        uint8_t link[CRSF_FRAME_LINK_STATISTICS_PAYLOAD_SIZE] = {50, 50, lq, 10, 0, 4, 1, 60, 100, 8};
+        appendFrame(out, CRSF_FRAMETYPE_LINK_STATISTICS, link, sizeof(link));
+    }
+}
+
+static void appendSbusFrame(std::vector<uint8_t> &out, double t)
+{
+    uint16_t ch[CRSF_NUM_CHANNELS];
+    rcChannels(t, ch);
+    uint8_t frame[SbusSerial::SBUS_FRAME_LEN] = {SbusSerial::SBUS_HEADER};
+    packChannels(ch, &frame[1]);
+    frame[24] = SbusSerial::SBUS_FOOTER;
+    out.insert(out.end(), frame, frame + sizeof(frame));
+}
+
+// Corrupt the frame that was just appended: garbage after it or a bit flip inside
+static bool addNoise(std::vector<uint8_t> &out, size_t frameStart, uint32_t pct)
+{
+    if (simRandom() % 100 >= pct)
+        return false;
+    if (simRandom() & 1)
+    {
+        for (uint32_t i = simRandom() % 40 + 1; i; --i)
+            out.push_back(simRandom());
+    }
+    else
+        out[frameStart + simRandom() % (out.size() - frameStart)] ^= 1 << (simRandom() % 8);
+    return true;
+}
+
+// main.cpp's CRSF endpoints, for the ideal stick values
+static constexpr ChannelTables truthTables(988, 2011, true);
+
+// How far the sticks the host reads are from where the synthetic sticks are at that time,
+// the effective latency of the whole path in axis units
+struct StickError
+{
+    double sum = 0;
+    uint32_t max = 0;
+    uint32_t samples = 0;
+
+    void add(double t)
+    {
+        uint16_t ch[CRSF_NUM_CHANNELS];
+        rcChannels(t, ch);
+        const uint16_t *axes = (const uint16_t *)&Joystick.lastReport()[4];
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            uint32_t err = abs((int32_t)axes[i] - truthTables.axis[ch[i]]);
+            sum += err;
+            max = err > max ? err : max;
+            ++samples;
+        }
+    }
+    double mean() const { return samples ? sum / samples : 0; }
+};
+
+// What the first receiver's parser made of the line while its baud rate was locked, the search
+// itself cuts garbage short and loses frames at the wrong rates
+struct LockedCounts
+{
+    uint32_t rcFrames = 0;
+    uint32_t gapDrops = 0;
+    uint32_t rcFramesSeen = 0;
+    uint32_t gapDropsSeen = 0;
+
+    void update(const CrsfParserStats &stats, bool locked)
+    {
+        if (locked)
+        {
+            rcFrames += stats.frames[CRSF_EVENT_CHANNELS] - rcFramesSeen;
+            gapDrops += stats.gapDrops - gapDropsSeen;
+        }
+        rcFramesSeen = stats.frames[CRSF_EVENT_CHANNELS];
+        gapDropsSeen = stats.gapDrops;
+    }
+};
+
+// Bytes of a burst arrive at a UART one byte time apart
+struct SimWire
+{
+    std::vector<uint8_t> bytes;
+    size_t pos = 0;
+    double start = 0;
+    double scale = 1; // byte time relative to the sender's
+    size_t pauseAt = 0; // the line goes idle before this byte
+    double pauseBytes = 0;
+
+    bool idle() const { return pos == bytes.size(); }
+    void restart(double at)
+    {
+        bytes.clear();
+        pos = 0;
+        start = at;
+        scale = 1;
+        pauseAt = 0;
+        pauseBytes = 0;
+    }
+    void feed(SimSerial &port, uint64_t now, double byteUs)
+    {
+        while (pos < bytes.size() && start + (pos + 1 + (pos >= pauseAt ? pauseBytes : 0)) * byteUs * scale <= now)
+            port.inject(&bytes[pos++], 1);
+    }
+    void resample(uint32_t txBaud, uint32_t rxBaud);
+};
+
+// Replace the burst, sent back to back as 8N1 at txBaud, with what a UART at rxBaud decodes:
+// it waits for a falling edge (sampling at 16x its bit rate), then reads 8 data bits and the
+// stop bit in the middle of its own bit times. Framing errors still deliver the byte.
+void SimWire::resample(uint32_t txBaud, uint32_t rxBaud)
+{
+    // Within 2% the bit timing holds up over a whole byte
+    if (rxBaud == 0 || fabs((double)txBaud / rxBaud - 1) < 0.02)
+        return;
+
+    const std::vector<uint8_t> sent(bytes);
+    const double bits = sent.size() * 10.0;
+    // Line level at t, in bit times of the sender
+    auto level = [&](double t) -> bool {
+        if (t >= bits)
+            return true;
+        size_t bit = (size_t)t;
+        uint8_t pos = bit % 10;
+        if (pos == 0 || pos == 9)
+            return pos == 9;
+        return sent[bit / 10] & (1 << (pos - 1));
+    };
+
+    const double rxBit = (double)txBaud / rxBaud;
+    bytes.clear();
+    double t = 0;
+    while (t < bits)
+    {
+        if (level(t))
+        {
+            t += rxBit / 16;
+            continue;
+        }
+        uint8_t b = 0;
+        for (uint8_t i = 0; i < 8; ++i)
+            if (level(t + rxBit * (1.5 + i)))
+                b |= 1 << i;
+        bytes.push_back(b);
+        // After a framing error the line has to go idle before the next start bit counts
+        t += rxBit * 9.5;
+        while (t < bits && !level(t))
+            t += rxBit / 16;
+    }
+    scale = bytes.empty() ? 1 : sent.size() / (double)bytes.size();
+}
+
+// USB serial output goes here instead of stdout while the firmware sends binary
+static std::vector<uint8_t> *usbCapture;
+static uint32_t telemetryBytes;
+
+static void drainUsb()
+{
+    uint8_t buf[256];
+    size_t len;
+    while ((len = Serial.drain(buf, sizeof(buf))) != 0)
+    {
+        if (usbCapture)
+            usbCapture->insert(usbCapture->end(), buf, buf + len);
+        else
+            fwrite(buf, 1, len, stdout);
+    }
+    // Whatever the firmware sends to the receiver
+    while ((len = Serial2.drain(buf, sizeof(buf))) != 0)
+        telemetryBytes += len;
+}
+
+// Run the firmware until the virtual clock reaches until
+static void runUntil(uint64_t until, uint32_t loopUs)
+{
+    while (SimClock::now() < until)
+    {
+        loop();
+        drainUsb();
+        SimClock::advance(loopUs);
+    }
+}
+
+static void sendCommand(const char *cmd, uint32_t loopUs)
+{
+    Serial.inject((const uint8_t *)cmd, strlen(cmd));
+    Serial.inject((const uint8_t *)"\r", 1);
+    runUntil(SimClock::now() + 100 * loopUs, loopUs);
+    if (!usbCapture)
+        printf("\n");
+}
+
+// Keep what the firmware sent over USB serial in path, an empty one doesn't
+static bool saveCapture(const char *path, const std::vector<uint8_t> &data)
+{
+    if (!*path)
+        return true;
+    FILE *out = fopen(path, "wb");
+    if (!out)
+    {
+        perror(path);
+        return false;
+    }
+    fwrite(data.data(), 1, data.size(), out);
+    fclose(out);
+    return true;
+}
+
+// Walk what "forward start" sent the way host software would, every frame has to pass its CRC
+// and nothing may be left between or after them
+static bool checkForward(const std::vector<uint8_t> &data, bool timestamped, SimResult &res)
+{
+    uint32_t frames = 0, rc = 0, bad = 0, lastUs = 0, maxGapUs = 0;
+    // The line ends of "forward start" and "forward stop" around the frames
+    size_t pos = 0, end = data.size();
+    if (pos < end && data[pos] == '\n')
+        ++pos;
+    if (pos < end && data[end - 1] == '\n')
+        --end;
+    const size_t stampLen = timestamped ? 4 : 0;
+    while (pos + stampLen + 2 <= end)
+    {
+        const uint8_t *frame = &data[pos + stampLen];
+        uint8_t len = frame[1];
+        if (len < 2 || pos + stampLen + 2 + len > end || CrsfCrc8::calc(&frame[2], len - 1) != frame[len + 1])
+        {
+            ++bad;
+            break;
+        }
+        if (timestamped)
+        {
+            uint32_t us = data[pos] | data[pos + 1] << 8 | data[pos + 2] << 16 | (uint32_t)data[pos + 3] << 24;
+            if (frames && us - lastUs > maxGapUs)
+                maxGapUs = us - lastUs;
+            lastUs = us;
+        }
+        ++frames;
+        if (frame[2] == CRSF_FRAMETYPE_RC_CHANNELS_PACKED)
+            ++rc;
+        pos += stampLen + 2 + len;
+    }
+    res.forwardedRc = rc;
+    res.forwardedOther = frames - rc;
+    res.forwardLeftover = end - pos;
+    bool ok = rc && !bad && pos == end;
+    printf("forwarded %u frames (%u RC), %u bad, %u bytes left over", frames, rc, bad, (unsigned)(end - pos));
+    if (timestamped)
+        printf(", longest gap %u us", maxGapUs);
+    printf("%s\n", ok ? "" : ", FAILED");
+    return ok;
+}
+
+// Decode a blackbox dump, the channels at its end have to be those of the last frame that arrived intact
+static bool checkBlackbox(const std::vector<uint8_t> &data, int32_t lastFrame, uint32_t rate, SimResult &res)
+{
+    // The line end of "blackbox dump" comes first
+    size_t skip = !data.empty() && data[0] == '\n' ? 1 : 0;
+    BlackboxReader reader(&data[skip], data.size() - skip);
+    if (!reader.valid())
+    {
+        printf("blackbox: FAILED, no valid dump\n");
+        return false;
+    }
+
+    BlackboxReader::Record rec;
+    uint32_t records = 0, frames = 0, links = 0, events = 0, firstUs = 0, lastUs = 0;
+    while (reader.next(&rec))
+    {
+        if (records++ == 0)
+            firstUs = rec.us;
+        lastUs = rec.us;
+        switch (rec.type)
+        {
+        case BLACKBOX_TAG_KEY:
+            if (rec.arg & BLACKBOX_KEY_FRAME)
+                ++frames;
+            break;
+        case BLACKBOX_TAG_FRAME:
+            ++frames;
+            break;
+        case BLACKBOX_TAG_REPEAT:
+            frames += rec.repeat;
+            break;
+        case BLACKBOX_TAG_LINK:
+            ++links;
+            break;
+        default:
+            ++events;
+        }
+    }
+
+    uint16_t expect[CRSF_NUM_CHANNELS];
+    rcChannels((double)lastFrame / rate, expect);
+    bool match = records && lastFrame >= 0 && memcmp(expect, rec.channels, sizeof(expect)) == 0;
+    res.blackboxFrames = frames;
+    res.blackboxLinks = links;
+    res.blackboxEvents = events;
+    res.blackboxSpanMs = (lastUs - firstUs) / 1000;
+    res.blackboxMatches = match;
+    printf("blackbox: %u bytes, %u records over %.3fs, %u frames, %u link statistics, %u events, last frame %s\n",
+           (unsigned)data.size(), records, (lastUs - firstUs) / 1e6, frames, links, events, match ? "matches" : "DIFFERS, FAILED");
+    return match;
+}
+
+static bool runSimulation(const SimOptions &opt, SimResult &res)
+{
+    const uint32_t period = 1000000 / opt.rate;
+    uint32_t baud = opt.baud;
+    double byteUs = 10e6 / baud; // 8N1
+
+    if (opt.rx2SkewUs >= 0 && diversity.getCount() < 2)
+    {
+        fprintf(stderr, "--rx2 needs the firmware built with DIVERSITY\n");
+        return false;
+    }
+
+    setup();
+    // A run before this one in the same process left its frames behind
+    sendCommand("reset blackbox", opt.loopUs);
+    for (const char *cmd : opt.cmds)
+        sendCommand(cmd, opt.loopUs);
+
+    std::vector<uint8_t> captured;
+    if (opt.record)
+    {
+        usbCapture = &captured;
+        sendCommand("capture start", opt.loopUs);
+    }
+    else if (opt.forward)
+    {
+        usbCapture = &captured;
+        sendCommand(opt.forwardTs ? "forward start ts" : "forward start", opt.loopUs);
+    }
+
+    SimWire wire, wire2, sbusWire;
+    uint64_t nextFrame = SimClock::now(), nextSbus = SimClock::now();
+    const uint64_t t0 = SimClock::now();
+    uint32_t frames = 0, corrupted = 0, sbusFrames = 0, frames2 = 0, packets = 0, split = 0, feeds = 0;
+    uint64_t nextFeed = SimClock::now();
+    std::vector<uint8_t> feedRest;
+    const uint32_t reportsBefore = Joystick.reportsSent();
+    uint32_t forwardedBefore = 0;
+    for (uint8_t i = 0; i < diversity.getCount(); ++i)
+        forwardedBefore += diversity.getReceiver(i).forwarded;
+    uint64_t nextPoll = SimClock::now();
+    uint32_t polledReports = Joystick.reportsSent(), pollWaits = 0, pollWaitMax = 0;
+    uint64_t pollWaitSum = 0;
+    uint64_t rebaudAt = 0, relockedAt = 0;
+    LockedCounts lockedCounts;
+    lockedCounts.update(crsf.getStats(), false);
+    uint32_t wholeFrames = 0, splitFrames = 0; // read while locked, like LockedCounts
+    bool wholeOnWire = false, splitOnWire = false;
+    int32_t lastIntact = -1; // the last frame that arrived as it was sent, at the rate the UART runs at
+    bool intactOnWire = false;
+    size_t rcEnd = 0; // where the RC frame on the wire ends, link statistics may follow it
+    StickError stickError;
+    const uint64_t end = SimClock::now() + (uint64_t)opt.seconds * 1000000;
+
+    while (SimClock::now() < end)
+    {
+        uint64_t now = SimClock::now();
+        uint32_t phaseMs = (now - t0) % 1000000 / 1000;
+        // The search itself cuts garbage short at the wrong rates, only count the locked ones. A lock
+        // left over from a run at another rate doesn't count either.
+        const bool locked = !crsf.isAutoBaud() || (crsf.getBaudProbe().isLocked() && Serial2.baud() == baud);
+
+        if (opt.rebaud && baud != opt.rebaud && now - t0 >= (uint64_t)opt.seconds * 500000 && wire.idle() && wire2.idle())
+        {
+            baud = opt.rebaud;
+            byteUs = 10e6 / baud;
+            rebaudAt = now;
+        }
+
+        wire.feed(Serial2, now, byteUs);
+        if (rcEnd && wire.pos >= rcEnd)
+        {
+            // The firmware reads the last byte of the frame this pass
+            if (wholeOnWire && locked)
+                ++wholeFrames;
+            if (splitOnWire && locked)
+                ++splitFrames;
+            if (intactOnWire)
+                lastIntact = frames - 1;
+            wholeOnWire = splitOnWire = intactOnWire = false;
+            rcEnd = 0;
+        }
+        wire2.feed(Serial3, now, byteUs);
+        if (wire.idle() && now >= nextFrame)
+        {
+            wire.restart(now);
+            if (phaseMs >= opt.outageMs)
+            {
+                appendRcFrame(wire.bytes, frames, opt.rate);
+                bool noisy = opt.noise && addNoise(wire.bytes, 0, opt.noise);
+                if (noisy)
+                    ++corrupted;
+                if (opt.split && locked && simRandom() % 100 < opt.split)
+                {
+                    // Every byte still arrives intact, the frame just isn't one anymore
+                    wire.pauseAt = CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE / 2;
+                    wire.pauseBytes = 2.5 * CrsfSerial::IDLE_GAP_BYTES;
+                    splitOnWire = true;
+                    ++split;
+                }
+                else
+                {
+                    wholeOnWire = true;
+                    intactOnWire = !noisy && Serial2.baud() == baud;
+                }
+                // Address, length, type, payload and CRC, a UART at another rate makes its own bytes of it
+                rcEnd = CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE + 4;
+                wire.resample(baud, Serial2.baud());
+                if (wire.bytes.size() < rcEnd)
+                    rcEnd = wire.bytes.size();
+            }
+            // The second receiver hears the same packet a little later
+            bool sent = phaseMs >= opt.outageMs;
+            if (opt.rx2SkewUs >= 0 && wire2.idle() && (phaseMs < 500 || phaseMs >= 500 + opt.outage2Ms))
+            {
+                wire2.restart(now + opt.rx2SkewUs);
+                appendRcFrame(wire2.bytes, frames, opt.rate, 90);
+                if (opt.noise)
+                    addNoise(wire2.bytes, 0, opt.noise);
+                wire2.resample(baud, Serial3.baud());
+                ++frames2;
+                sent = true;
+            }
+            if (sent)
+                ++packets;
+            if (phaseMs >= opt.outageMs)
+                ++frames;
+            nextFrame += period;
+        }
+
+        // Telemetry from the host, half of it now and the rest a pass later, mixed with the CLI
+        if (!feedRest.empty())
+        {
+            Serial.inject(&feedRest[0], feedRest.size());
+            feedRest.clear();
+        }
+        else if (opt.feedHz && now >= nextFeed)
+        {
+            std::vector<uint8_t> feed;
+            int16_t angle = feeds * 10;
+            uint8_t attitude[CRSF_FRAME_ATTITUDE_PAYLOAD_SIZE] = {(uint8_t)(angle >> 8), (uint8_t)angle, 0, 0, 0, 0};
+            appendFrame(feed, CRSF_FRAMETYPE_ATTITUDE, attitude, sizeof(attitude));
+            if (feeds % 10 == 0)
+            {
+                uint8_t battery[CRSF_FRAME_BATTERY_SENSOR_PAYLOAD_SIZE] = {0, 168, 0, 12, 0, 0, 0, (uint8_t)(100 - feeds / 10 % 100)};
+                appendFrame(feed, CRSF_FRAMETYPE_BATTERY_SENSOR, battery, sizeof(battery));
+            }
+            Serial.inject(&feed[0], feed.size() / 2);
+            feedRest.assign(feed.begin() + feed.size() / 2, feed.end());
+            ++feeds;
+            nextFeed += 1000000 / opt.feedHz;
+        }
+
+        // SBUS is 100000 baud 8E2, 12 bits per byte
+        sbusWire.feed(Serial1, now, 120);
+        if (opt.sbus && sbusWire.idle() && now >= nextSbus)
+        {
+            sbusWire.restart(now);
+            appendSbusFrame(sbusWire.bytes, (now - t0) / 1e6);
+            ++sbusFrames;
+            nextSbus += 14000;
+        }
+
+        loop();
+        drainUsb();
+        lockedCounts.update(crsf.getStats(), locked);
+        if (rebaudAt && !relockedAt && crsf.getBaudProbe().isLocked() && crsf.getBaud() == opt.rebaud)
+            relockedAt = now;
+        // The host polls every pollUs and sees whatever was sent last, the first frame needs a moment to arrive
+        if (now >= nextPoll)
+        {
+            if (now - t0 > period)
+                stickError.add((now - t0) / 1e6);
+            // How long the newest report waited for this poll
+            if (Joystick.reportsSent() != polledReports)
+            {
+                polledReports = Joystick.reportsSent();
+                uint32_t waited = (uint32_t)now - Joystick.lastSendUs();
+                pollWaitSum += waited;
+                pollWaitMax = waited > pollWaitMax ? waited : pollWaitMax;
+                ++pollWaits;
+            }
+            nextPoll += opt.pollUs;
+        }
+        SimClock::advance(opt.loopUs);
+    }
+
+    bool ok = true;
+    if (usbCapture)
+    {
+        sendCommand(opt.record ? "capture stop" : "forward stop", opt.loopUs);
+        usbCapture = NULL;
+        ok = saveCapture(opt.record ? opt.record : opt.forward, captured);
+    }
+    if (opt.forward && !checkForward(captured, opt.forwardTs, res))
+        ok = false;
+    if (opt.blackbox)
+    {
+        std::vector<uint8_t> dump;
+        usbCapture = &dump;
+        sendCommand("blackbox dump", opt.loopUs);
+        usbCapture = NULL;
+        if (!saveCapture(opt.blackbox, dump))
+            ok = false;
+        if (!checkBlackbox(dump, lastIntact, opt.rate, res))
+            ok = false;
+    }
+
+    res.frames = frames;
+    res.corrupted = corrupted;
+    res.split = split;
+    res.packets = packets;
+    res.reports = Joystick.reportsSent() - reportsBefore;
+    res.baud = Serial2.baud();
+    res.rcDecoded = lockedCounts.rcFrames;
+    res.wholeFrames = wholeFrames;
+    res.splitFrames = splitFrames;
+    res.gapDrops = lockedCounts.gapDrops;
+
+    printf("simulated %us: %u RC frames at %u Hz, %u corrupted, %u split, %u on rx2, %u SBUS frames, %u joystick reports, %u telemetry bytes, LED %s, rx overruns %u, UART at %u baud\n",
+           opt.seconds, frames, opt.rate, corrupted, split, frames2, sbusFrames, Joystick.reportsSent() - reportsBefore, telemetryBytes,
+           simPinState(LED_BUILTIN) ? "on" : "off", Serial2.rxOverruns(), Serial2.baud());
+    printf("stick error at host poll: mean %.0f, max %u (of %u)\n", stickError.mean(), stickError.max, AXIS_MAX);
+    printf("reports wait for the host poll every %u us: mean %.0f us, max %u us\n", opt.pollUs,
+           pollWaits ? (double)pollWaitSum / pollWaits : 0.0, pollWaitMax);
+    if (opt.feedHz)
+        printf("host telemetry: %u updates fed\n", feeds);
+
+    if (opt.rebaud)
+    {
+        // Noticing the lost lock, then at worst a dwell on every rate before it comes around to the new one
+        const uint32_t limitMs = CrsfBaudProbe::LOCK_TIMEOUT_MS + CrsfBaudProbe::RATE_COUNT * CrsfBaudProbe::DWELL_MS;
+        res.relockMs = relockedAt ? (relockedAt - rebaudAt) / 1000 : -1;
+        if (relockedAt && relockedAt - rebaudAt <= limitMs * 1000)
+            printf("rebaud: locked at %u baud %.0f ms after the switch\n", opt.rebaud, (relockedAt - rebaudAt) / 1e3);
+        else
+        {
+            ok = false;
+            printf("rebaud: FAILED, no lock at %u baud within %u ms of the switch\n", opt.rebaud, limitMs);
+        }
+    }
+
+    // On a clean line at a steady rate every whole frame gets through and every split one is
+    // dropped at its gap, the second half may hold a false start that goes the same way
+    if (opt.split && !opt.noise && !opt.rebaud)
+    {
+        if (lockedCounts.rcFrames == wholeFrames && lockedCounts.gapDrops >= splitFrames)
+            printf("split: %u whole frames through, %u split frames dropped at %u gaps\n", wholeFrames, splitFrames,
+                   lockedCounts.gapDrops);
+        else
+        {
+            ok = false;
+            printf("split: FAILED, %u RC frames through for %u whole ones, %u gap drops for %u split frames\n",
+                   lockedCounts.rcFrames, wholeFrames, lockedCounts.gapDrops, splitFrames);
+        }
+    }
+
+    // Whatever the skew, the late copy of a packet is not a new one
+    if (opt.rx2SkewUs >= 0)
+    {
+        uint32_t forwarded = 0;
+        for (uint8_t i = 0; i < diversity.getCount(); ++i)
+            forwarded += diversity.getReceiver(i).forwarded;
+        forwarded -= forwardedBefore;
+        res.diversityForwarded = forwarded;
+        if (forwarded <= packets)
+            printf("diversity: %u frames forwarded for %u packets\n", forwarded, packets);
+        else
+        {
+            ok = false;
+            printf("diversity: FAILED, %u frames forwarded for %u packets\n", forwarded, packets);
+        }
+    }
+
+    for (const char *cmd : opt.queries)
+        sendCommand(cmd, opt.loopUs);
+    return ok;
+}
+
+static bool runReplay(const SimOptions &opt)
+{
+    std::vector<uint8_t> file;
+    FILE *in = fopen(opt.replay, "rb");
+    if (!in)
+    {
+        perror(opt.replay);
+        return false;
+    }
+    int c;
+    while ((c = fgetc(in)) != EOF)
+        file.push_back(c);
+    fclose(in);
+
+    // A capture taken from a terminal may have text in front of it
+    size_t start = 0;
+    while (start + sizeof(CAPTURE_MAGIC) <= file.size() && memcmp(&file[start], CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0)
+        ++start;
+    CaptureReader reader(file.data() + start, file.size() - start);
+    if (!reader.valid())
+    {
+        fprintf(stderr, "%s: not a capture\n", opt.replay);
+        return false;
+    }
+
+    setup();
+    for (const char *cmd : opt.cmds)
+        sendCommand(cmd, opt.loopUs);
+
+    const uint32_t reportsBefore = Joystick.reportsSent();
+    const uint64_t t0 = SimClock::now();
+    uint8_t source, len;
+    uint32_t us, records = 0, bytes = 0;
+    const uint8_t *data;
+    while (reader.next(&source, &us, &data, &len))
+    {
+        runUntil(t0 + us, opt.loopUs);
+        (source == CAPTURE_SOURCE_SBUS ? Serial1 : source == CAPTURE_SOURCE_CRSF2 ? Serial3 : Serial2).inject(data, len);
+        ++records;
+        bytes += len;
+    }
+    runUntil(SimClock::now() + 100000, opt.loopUs);
+
+    printf("replayed %.3fs: %u records, %u bytes, %u joystick reports, LED %s, rx overruns %u\n",
+           (SimClock::now() - t0) / 1e6, records, bytes, Joystick.reportsSent() - reportsBefore,
+           simPinState(LED_BUILTIN) ? "on" : "off", Serial2.rxOverruns());
+
+    for (const char *cmd : opt.queries)
+        sendCommand(cmd, opt.loopUs);
+    return true;
+}
+
+static double elapsedNs(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Receiver flashing: the host writes a blob as fast as USB takes it, the receiver echoes every
+// byte back, both UART directions run at the wire rate of --baud
+static bool runFlash(const SimOptions &opt)
+{
+    const double byteUs = 10e6 / opt.baud;
+    std::vector<uint8_t> blob(opt.flashKb * 1024), echo;
+    for (auto &b : blob)
+        b = simRandom();
+
+    Serial2.setRxCapacity(64); // Teensy 3 Serial2, the firmware adds its own memory
+    setup();
+    char cmd[32];
+    snprintf(cmd, sizeof(cmd), "serialpassthrough 5 %u", opt.baud);
+    sendCommand(cmd, opt.loopUs);
+
+    std::vector<uint8_t> wire; // bytes the receiver got and still has to send back
+    size_t sent = 0, wireOut = 0;
+    double txDone = SimClock::now(), rxDone = SimClock::now();
+    const uint64_t t0 = SimClock::now();
+    const uint64_t timeout = t0 + (uint64_t)(blob.size() * byteUs * 4) + 1000000;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t passes = 0;
+
+    while (echo.size() < blob.size() && SimClock::now() < timeout)
+    {
+        uint64_t now = SimClock::now();
+
+        // Host side, USB flow control only lets in what fits
+        size_t room = Serial.rxCapacity() - Serial.available();
+        size_t len = min(room, blob.size() - sent);
+        sent += Serial.inject(&blob[sent], len);
+
+        // Firmware to receiver and back at the wire rate, a byte is done byteUs after the previous one
+        uint8_t b;
+        while (txDone + byteUs <= now && Serial2.drain(&b, 1))
+        {
+            wire.push_back(b);
+            txDone += byteUs;
+        }
+        if (txDone + byteUs <= now)
+            txDone = now; // idle line
+        while (rxDone + byteUs <= now && wireOut < wire.size())
+        {
+            Serial2.inject(&wire[wireOut++], 1);
+            rxDone += byteUs;
+        }
+        if (rxDone + byteUs <= now)
+            rxDone = now;
+
+        loop();
+        ++passes;
+        uint8_t buf[256];
+        while ((len = Serial.drain(buf, sizeof(buf))) != 0)
+            echo.insert(echo.end(), buf, buf + len);
+
+        SimClock::advance(opt.loopUs);
+    }
+
+    double wall = elapsedNs(start);
+    double secs = (SimClock::now() - t0) / 1e6;
+    bool intact = echo.size() == blob.size() && memcmp(echo.data(), blob.data(), blob.size()) == 0;
+    printf("flashed %zu bytes at %u baud in %.2fs: %.0f B/s each way (wire %.0f B/s), echo %s\n",
+           blob.size(), opt.baud, secs, echo.size() / secs, opt.baud / 10.0, intact ? "intact" : "CORRUPT");
+    printf("to uart %u, to usb %u, uart stalls %u, usb stalls %u, overruns %u, rx high water %u, lost %u\n",
+           bridge.getToUart(), bridge.getToUsb(), bridge.getUartStalls(), bridge.getUsbStalls(),
+           bridge.getOverruns(), bridge.getRxHighWater(), Serial2.rxOverruns());
+    printf("host cpu %.1f ns per loop() pass, %.1f ns per byte\n", wall / passes, wall / (bridge.getToUart() + bridge.getToUsb()));
+    return intact;
+}
+
+// Push a stream through a parser 16 bytes per loop() like a UART FIFO would deliver it
+static void benchParser(const char *name, const std::vector<uint8_t> &stream)
+{
+    struct BenchEvents : CrsfHandler
+    {
+        uint32_t frames = 0;
+        void onPacketChannels(CrsfSerial &) { ++frames; }
+    } events;
+    static CrsfSerialPort<HalUart3> crsf(Serial3, CRSF_BAUDRATE);
+
+    double worst = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t pos = 0; pos < stream.size(); pos += 16)
+    {
+        size_t len = min(stream.size() - pos, (size_t)16);
+        Serial3.inject(&stream[pos], len);
+        auto t = std::chrono::steady_clock::now();
+        crsf.loop(events);
+        double perByte = elapsedNs(t) / len;
+        if (perByte > worst)
+            worst = perByte;
+        SimClock::advance(1000);
+    }
+    double total = elapsedNs(start);
+
+    printf("parser %-10s %8zu bytes %7u frames %7.1f MB/s  worst %6.0f ns/byte\n",
+           name, stream.size(), events.frames, stream.size() * 1e3 / total, worst);
+}
+
+static void benchCrc(uint8_t len)
+{
+    const uint32_t rounds = 2000000;
+    uint8_t buf[CRSF_MAX_PACKET_LEN];
+    for (auto &b : buf)
+        b = simRandom();
+
+    // The generic byte-at-a-time Crc8, what CrsfSerial used before the slice-by-4 kernel
+    static Crc8 reference(CrsfCrc8::POLY);
+    volatile uint8_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < rounds; ++i)
+    {
+        buf[0] = i;
+        sink = sink + reference.calc(buf, len);
+    }
+    double bytewise = elapsedNs(start) / rounds;
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < rounds; ++i)
+    {
+        buf[0] = i;
+        sink = sink + CrsfCrc8::calc(buf, len);
+    }
+    double sliced = elapsedNs(start) / rounds;
+
+    printf("crc8 %2u bytes: bytewise %6.1f ns  slice-by-4 %6.1f ns\n", len, bytewise, sliced);
+}
+
+// Map the four sticks of many frames through a curve, the cost should not depend on the settings
+static void benchCurve(const char *name, const CurveConfig &config)
+{
+    static const ChannelMapping sticks[] = {
+        {0, MAP_AXIS, 0, false},
+        {1, MAP_AXIS, 1, false},
+        {2, MAP_AXIS, 2, false},
+        {3, MAP_AXIS, 3, false},
+    };
+    static const int16_t hats[3] = {0, 0, 0};
+    static constexpr ChannelTables tables(988, 2011, true);
+    static ChannelMapper mapper(sticks, 4, hats);
+    for (uint8_t axis = 0; axis < ChannelMapper::CURVE_AXES; ++axis)
+        mapper.setCurve(axis, config);
+
+    const uint32_t frames = 2000000;
+    uint16_t raw[CRSF_NUM_CHANNELS] = {0};
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < frames; ++n)
+    {
+        for (unsigned int i = 0; i < 4; ++i)
+            raw[i] = CRSF_CHANNEL_VALUE_MIN + (n * (i + 1) * 7) % (CRSF_CHANNEL_VALUE_MAX - CRSF_CHANNEL_VALUE_MIN);
+        mapper.apply(raw, tables);
+    }
+    printf("curve %-28s %6.1f ns/frame\n", name, elapsedNs(start) / frames);
+}
+
+// Whole frame through the mapper, all channels moving
+static void benchLayout(const char *name, uint8_t layout, const ChannelMapping *map, uint8_t count)
+{
+    static const int16_t hats[3] = {0, 0, 0};
+    static constexpr ChannelTables tables(988, 2011, true);
+    ChannelMapper mapper(map, count, hats);
+    mapper.setLayout(layout);
+
+    const uint32_t frames = 2000000;
+    uint16_t raw[CRSF_NUM_CHANNELS] = {0};
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < frames; ++n)
+    {
+        for (unsigned int i = 0; i < CRSF_NUM_CHANNELS; ++i)
+            raw[i] = CRSF_CHANNEL_VALUE_MIN + (n * (i + 1) * 7) % (CRSF_CHANNEL_VALUE_MAX - CRSF_CHANNEL_VALUE_MIN);
+        mapper.apply(raw, tables);
+    }
+    printf("layout %-27s %6.1f ns/frame\n", name, elapsedNs(start) / frames);
+}
+
+// The simulation's sticks at 500 Hz for 10 minutes, bytes per frame shows what fits in the ring
+static void benchBlackbox()
+{
+    static Blackbox blackbox;
+    const uint32_t frames = 300000;
+    std::vector<uint16_t> raw(frames * CRSF_NUM_CHANNELS);
+    for (uint32_t n = 0; n < frames; ++n)
+        rcChannels(n / 500.0, &raw[n * CRSF_NUM_CHANNELS]);
+
+    const uint32_t rounds = 4;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; ++r)
+    {
+        blackbox.reset();
+        for (uint32_t n = 0; n < frames; ++n)
+            blackbox.onChannels(&raw[n * CRSF_NUM_CHANNELS], 0, n * 2000);
+    }
+    double ns = elapsedNs(start) / (rounds * frames);
+    // The frames from the oldest key to the last one share the ring
+    double held = blackbox.spanUs() / 2000.0 + 1;
+    printf("blackbox encode %6.1f ns/frame, %.1f bytes/frame, %.1fs at 500 Hz\n", ns, blackbox.used() / held,
+           held / 500);
+}
+
+static void runBench()
+{
+    std::vector<uint8_t> clean, noisy;
+    for (uint32_t n = 0; n < 40000; ++n)
+    {
+        appendRcFrame(clean, n, 500);
+        size_t start = noisy.size();
+        appendRcFrame(noisy, n, 500);
+        addNoise(noisy, start, 30);
+    }
+    benchParser("clean", clean);
+    benchParser("corrupted", noisy);
+
+    benchCrc(CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE + 1);
+    benchCrc(CRSF_MAX_PACKET_LEN - 2);
+
+    benchCurve("linear (bypassed)", {0, 0, 0, 100});
+    benchCurve("expo 30", {0, 0, 30, 100});
+    benchCurve("center, deadband, expo, rate", {10, 5, 80, 150});
+
+    // main.cpp's channelMap
+    static const ChannelMapping map[] = {
+        {0, MAP_AXIS, 0, false}, {1, MAP_AXIS, 1, false}, {2, MAP_AXIS, 2, false}, {3, MAP_AXIS, 3, false},
+        {4, MAP_AXIS, 4, false}, {5, MAP_AXIS, 5, false}, {6, MAP_SLIDER, 1, false}, {7, MAP_HAT, 1, false},
+        {4, MAP_BUTTONS, 1, false}, {5, MAP_BUTTONS, 4, false}, {6, MAP_BUTTONS, 7, false},
+        {7, MAP_BUTTONS, 10, false}, {8, MAP_BUTTONS, 13, false}, {9, MAP_BUTTONS, 16, false},
+        {10, MAP_BUTTONS, 19, false}, {11, MAP_BUTTONS, 22, false}, {12, MAP_BUTTONS, 25, false},
+        {13, MAP_BUTTONS, 28, false}, {14, MAP_BUTTONS, 31, false}, {15, MAP_BUTTONS, 34, false},
+    };
+    benchLayout("mapped", LAYOUT_MAPPED, map, sizeof(map) / sizeof(map[0]));
+    benchLayout("channels", LAYOUT_CHANNELS, map, sizeof(map) / sizeof(map[0]));
+
+    benchBlackbox();
+}
+
+// The whole program, main() outside of the tests
+int simMain(int argc, const char *const *argv, SimResult *result)
+{
+    SimOptions opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : "0";
+        if (strcmp(arg, "--bench") == 0)
+            opt.bench = true;
+        else if (strcmp(arg, "--seconds") == 0)
+            opt.seconds = atoi(val), ++i;
+        else if (strcmp(arg, "--rate") == 0)
+            opt.rate = atoi(val), ++i;
+        else if (strcmp(arg, "--baud") == 0)
+            opt.baud = atoi(val), ++i;
+        else if (strcmp(arg, "--split") == 0)
+            opt.split = atoi(val), ++i;
+        else if (strcmp(arg, "--rebaud") == 0)
+            opt.rebaud = atoi(val), ++i;
+        else if (strcmp(arg, "--loop") == 0)
+            opt.loopUs = atoi(val), ++i;
+        else if (strcmp(arg, "--poll") == 0)
+            opt.pollUs = atoi(val), ++i;
+        else if (strcmp(arg, "--noise") == 0)
+            opt.noise = atoi(val), ++i;
+        else if (strcmp(arg, "--sbus") == 0)
+            opt.sbus = true;
+        else if (strcmp(arg, "--outage") == 0)
+            opt.outageMs = atoi(val), ++i;
+        else if (strcmp(arg, "--rx2") == 0)
+            opt.rx2SkewUs = atoi(val), ++i;
+        else if (strcmp(arg, "--outage2") == 0)
+            opt.outage2Ms = atoi(val), ++i;
+        else if (strcmp(arg, "--flash") == 0)
+            opt.flashKb = atoi(val), ++i;
+        else if (strcmp(arg, "--blackbox") == 0)
+            opt.blackbox = val, ++i;
+        else if (strcmp(arg, "--feed") == 0)
+            opt.feedHz = atoi(val), ++i;
+        else if (strcmp(arg, "--cmd") == 0)
+            opt.cmds.push_back(val), ++i;
+        else if (strcmp(arg, "--query") == 0)
+            opt.queries.push_back(val), ++i;
+        else if (strcmp(arg, "--record") == 0)
+            opt.record = val, ++i;
+        else if (strcmp(arg, "--forward") == 0 || strcmp(arg, "--forward-ts") == 0)
+            opt.forward = val, opt.forwardTs = arg[9] != 0, ++i;
+        else if (strcmp(arg, "--replay") == 0)
+            opt.replay = val, ++i;
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return 1;
+        }
+    }
+
+    if (opt.rate == 0 || opt.baud == 0 || opt.loopUs == 0 || opt.pollUs == 0)
+    {
+        fprintf(stderr, "rate, baud, loop and poll must be > 0\n");
+        return 1;
+    }
+
+    bool ok = true;
+    if (opt.bench)
+        runBench();
+    else if (opt.flashKb)
+        ok = runFlash(opt);
+    else if (opt.replay)
+        ok = runReplay(opt);
+    else
+    {
+        SimResult res = SimResult();
+        res.relockMs = -1;
+        ok = runSimulation(opt, res);
+        if (result)
+            *result = res;
+    }
+    return ok ? 0 : 1;
+}
+
+#ifndef PIO_UNIT_TESTING
+int main(int argc, char **argv)
+{
+    return simMain(argc, argv);
+}
+#endif
+
+#endif // !ARDUINO
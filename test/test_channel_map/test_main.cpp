@@ -0,0 +1,177 @@
+#include <unity.h>
+#include <Hal.h>
+#include <ChannelMap.h>
+
+// The default mapping through ChannelMapper against the setSticks()/setButtons() it replaced,
+// which called map() on every channel. Both write the joystick report, each keeps its own copy.
+
+// main.cpp's endpoints and channelMap
+#define STARTPOINT 221
+#define ENDPOINT 1824
+#define US_MIN 988
+#define US_MAX 2011
+
+static const ChannelMapping channelMap[] = {
+    {0, MAP_AXIS, 0, false}, {1, MAP_AXIS, 1, false}, {2, MAP_AXIS, 2, false}, {3, MAP_AXIS, 3, false},
+    {4, MAP_AXIS, 4, false}, {5, MAP_AXIS, 5, false}, {6, MAP_SLIDER, 1, false}, {7, MAP_HAT, 1, false},
+    {4, MAP_BUTTONS, 1, false}, {5, MAP_BUTTONS, 4, false}, {6, MAP_BUTTONS, 7, false},
+    {7, MAP_BUTTONS, 10, false}, {8, MAP_BUTTONS, 13, false}, {9, MAP_BUTTONS, 16, false},
+    {10, MAP_BUTTONS, 19, false}, {11, MAP_BUTTONS, 22, false}, {12, MAP_BUTTONS, 25, false},
+    {13, MAP_BUTTONS, 28, false}, {14, MAP_BUTTONS, 31, false}, {15, MAP_BUTTONS, 34, false},
+};
+static const int16_t hats[3] = {293, 338, 0};
+
+static constexpr ChannelTables crsfTables(US_MIN, US_MAX, true);
+static constexpr ChannelTables sbusTables(STARTPOINT, ENDPOINT, false);
+
+typedef uint32_t Report[(JOYSTICK_SIZE + 3) / 4];
+
+// The old path: ch holds us for CRSF and raw values for SBUS, _min/_max their endpoints
+static void scalarMap(const uint16_t *ch, long _min, long _max)
+{
+    Joystick.X(map(ch[0], _min, _max, 0, 65535));
+    Joystick.Y(map(ch[1], _min, _max, 0, 65535));
+    Joystick.Z(map(ch[2], _min, _max, 0, 65535));
+    Joystick.Xrotate(map(ch[3], _min, _max, 0, 65535));
+    Joystick.Yrotate(map(ch[4], _min, _max, 0, 65535));
+    Joystick.Zrotate(map(ch[5], _min, _max, 0, 65535));
+    Joystick.slider(1, map(ch[6], _min, _max, 0, 65535));
+    Joystick.hat(1, hats[map(ch[7], _min, _max, 0, 2)]);
+    for (uint8_t button = 0; button < CRSF_NUM_CHANNELS - 4; ++button)
+        for (uint8_t position = 0; position < 3; ++position)
+            Joystick.button(button * 3 + position + 1, (uint8_t)map(ch[4 + button], _min, _max, 0, 2) == position);
+}
+
+struct Compare
+{
+    ChannelMapper mapper;
+    const ChannelTables &tables;
+    bool crsfUs;
+    long inMin, inMax;
+    Report expected, actual;
+
+    Compare(const ChannelTables &t, bool us, long lo, long hi) :
+        mapper(channelMap, sizeof(channelMap) / sizeof(channelMap[0]), hats), tables(t), crsfUs(us), inMin(lo), inMax(hi),
+        expected(), actual()
+    {
+    }
+
+    // Raw 11-bit frame through both paths, the reports have to be the same
+    void frame(const uint16_t *raw, const char *what)
+    {
+        uint16_t ch[CRSF_NUM_CHANNELS];
+        for (uint8_t i = 0; i < CRSF_NUM_CHANNELS; ++i)
+            ch[i] = crsfUs ? map(raw[i], CRSF_CHANNEL_VALUE_1000, CRSF_CHANNEL_VALUE_2000, 1000, 2000) : raw[i];
+
+        memcpy(usb_joystick_data, expected, sizeof(Report));
+        scalarMap(ch, inMin, inMax);
+        memcpy(expected, usb_joystick_data, sizeof(Report));
+
+        memcpy(usb_joystick_data, actual, sizeof(Report));
+        mapper.apply(raw, tables);
+        memcpy(actual, usb_joystick_data, sizeof(Report));
+
+        for (uint8_t w = 0; w < sizeof(Report) / 4; ++w)
+            TEST_ASSERT_EQUAL_UINT32_MESSAGE(expected[w], actual[w], what);
+    }
+
+    // Between the endpoints, outside them the old path wrapped
+    bool inRange(uint16_t raw) const
+    {
+        long x = crsfUs ? map(raw, CRSF_CHANNEL_VALUE_1000, CRSF_CHANNEL_VALUE_2000, 1000, 2000) : raw;
+        return x >= inMin && x <= inMax;
+    }
+};
+
+static uint32_t rngState = 0x12345678;
+
+static uint32_t random32()
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+// Every in-range value on every channel, the others at a value in range
+static void sweep(Compare &cmp, uint16_t rest)
+{
+    for (uint8_t ch = 0; ch < CRSF_NUM_CHANNELS; ++ch)
+        for (uint16_t v = 0; v < 2048; ++v)
+        {
+            if (!cmp.inRange(v))
+                continue;
+            uint16_t raw[CRSF_NUM_CHANNELS];
+            for (uint16_t &r : raw)
+                r = rest;
+            raw[ch] = v;
+            char msg[40];
+            snprintf(msg, sizeof(msg), "channel %u value %u", ch + 1, v);
+            cmp.frame(raw, msg);
+        }
+}
+
+static void randomFrames(Compare &cmp, uint32_t count)
+{
+    uint16_t lo = 0, hi = 2047;
+    while (!cmp.inRange(lo))
+        ++lo;
+    while (!cmp.inRange(hi))
+        --hi;
+    for (uint32_t n = 0; n < count; ++n)
+    {
+        uint16_t raw[CRSF_NUM_CHANNELS];
+        for (uint16_t &r : raw)
+            r = lo + random32() % (hi - lo + 1);
+        cmp.frame(raw, "random frame");
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_crsf_every_value()
+{
+    Compare cmp(crsfTables, true, US_MIN, US_MAX);
+    sweep(cmp, CRSF_CHANNEL_VALUE_MID);
+    randomFrames(cmp, 100000);
+}
+
+static void test_sbus_every_value()
+{
+    Compare cmp(sbusTables, false, STARTPOINT, ENDPOINT);
+    sweep(cmp, (STARTPOINT + ENDPOINT) / 2);
+    randomFrames(cmp, 100000);
+}
+
+// Where the old path wrapped, the tables stop at the ends
+static void test_out_of_range_clamps()
+{
+    for (uint16_t raw = 0; raw < 2048; ++raw)
+    {
+        long us = map(raw, CRSF_CHANNEL_VALUE_1000, CRSF_CHANNEL_VALUE_2000, 1000, 2000);
+        if (us < US_MIN)
+        {
+            TEST_ASSERT_EQUAL_UINT16(0, crsfTables.axis[raw]);
+            TEST_ASSERT_EQUAL_UINT8(0, crsfTables.position[raw]);
+        }
+        else if (us > US_MAX)
+        {
+            TEST_ASSERT_EQUAL_UINT16(AXIS_MAX, crsfTables.axis[raw]);
+            TEST_ASSERT_EQUAL_UINT8(2, crsfTables.position[raw]);
+        }
+        if (raw < STARTPOINT)
+            TEST_ASSERT_EQUAL_UINT16(0, sbusTables.axis[raw]);
+        else if (raw > ENDPOINT)
+            TEST_ASSERT_EQUAL_UINT16(AXIS_MAX, sbusTables.axis[raw]);
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_crsf_every_value);
+    RUN_TEST(test_sbus_every_value);
+    RUN_TEST(test_out_of_range_clamps);
+    return UNITY_END();
+}
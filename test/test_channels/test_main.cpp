@@ -0,0 +1,102 @@
+#include <unity.h>
+#include <Hal.h>
+#include <CrsfChannels.h>
+
+// The shift unpacker against the crsf_channels_t bitfields it replaced, and the us table
+// against the map() call it replaced. Run with pio test -e native.
+
+static uint32_t rngState = 0x12345678;
+
+static uint32_t random32()
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+// What CrsfSerial did before crsfUnpackChannels()
+static void unpackBitfields(const uint8_t *payload, uint16_t *ch)
+{
+    crsf_channels_t packed;
+    memcpy(&packed, payload, sizeof(packed));
+    ch[0] = packed.ch0;
+    ch[1] = packed.ch1;
+    ch[2] = packed.ch2;
+    ch[3] = packed.ch3;
+    ch[4] = packed.ch4;
+    ch[5] = packed.ch5;
+    ch[6] = packed.ch6;
+    ch[7] = packed.ch7;
+    ch[8] = packed.ch8;
+    ch[9] = packed.ch9;
+    ch[10] = packed.ch10;
+    ch[11] = packed.ch11;
+    ch[12] = packed.ch12;
+    ch[13] = packed.ch13;
+    ch[14] = packed.ch14;
+    ch[15] = packed.ch15;
+}
+
+static void checkPayload(const uint8_t *payload)
+{
+    uint16_t expected[CRSF_NUM_CHANNELS], actual[CRSF_NUM_CHANNELS];
+    unpackBitfields(payload, expected);
+    crsfUnpackChannels(payload, actual);
+    for (uint8_t ch = 0; ch < CRSF_NUM_CHANNELS; ++ch)
+    {
+        char msg[32];
+        snprintf(msg, sizeof(msg), "channel %u", ch + 1);
+        TEST_ASSERT_EQUAL_UINT16_MESSAGE(expected[ch], actual[ch], msg);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_unpack_random_payloads()
+{
+    uint8_t payload[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE];
+    for (uint32_t n = 0; n < 100000; ++n)
+    {
+        for (uint8_t &b : payload)
+            b = random32();
+        checkPayload(payload);
+    }
+}
+
+// Every single bit set on its own ends up in exactly one channel, at the right place
+static void test_unpack_single_bits()
+{
+    uint8_t payload[CRSF_FRAME_RC_CHANNELS_PAYLOAD_SIZE];
+    for (uint16_t bit = 0; bit < 8 * sizeof(payload); ++bit)
+    {
+        memset(payload, 0, sizeof(payload));
+        payload[bit / 8] = 1 << (bit % 8);
+        checkPayload(payload);
+
+        memset(payload, 0xFF, sizeof(payload));
+        payload[bit / 8] &= ~(1 << (bit % 8));
+        checkPayload(payload);
+    }
+}
+
+static void test_us_table_matches_map()
+{
+    for (uint16_t raw = 0; raw < 2048; ++raw)
+    {
+        char msg[32];
+        snprintf(msg, sizeof(msg), "raw %u", raw);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(map(raw, CRSF_CHANNEL_VALUE_1000, CRSF_CHANNEL_VALUE_2000, 1000, 2000),
+                                      crsfChannelToUs(raw), msg);
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_unpack_random_payloads);
+    RUN_TEST(test_unpack_single_bits);
+    RUN_TEST(test_us_table_matches_map);
+    return UNITY_END();
+}
@@ -0,0 +1,108 @@
+#include <unity.h>
+#include <math.h>
+#include <ResponseCurve.h>
+
+// ResponseCurve's fixed-point table and integer interpolation against the curve in double
+// precision, over every 16-bit input.
+//
+// Tolerances, in LSB of the 0..65535 output:
+//  - 1 against the reference interpolated between the same table points: what the table
+//    rounding and the integer interpolation may add
+//  - 3 against the reference itself on curves without a kink (no centre shift, no deadband,
+//    rate up to 100): a fully cubic curve bends away from the line between two of the 257
+//    points by up to 1.5, the rounded table and the truncating interpolation add the rest
+
+// The curve ResponseCurve::configure() samples, in -1..1 around the centre, for in 0..1
+static double reference(const CurveConfig &c, double in)
+{
+    const double center = 0.5 + c.center / 100.0;
+    const double deadband = c.deadband / 100.0;
+    const double expo = c.expo / 100.0;
+    double x = (in >= center) ? (in - center) / (1.0 - center) : (in - center) / center;
+    double mag = fabs(x);
+    mag = (mag <= deadband) ? 0.0 : (mag - deadband) / (1.0 - deadband);
+    mag = (1.0 - expo) * mag + expo * mag * mag * mag;
+    mag = fmin(mag * c.rate / 100.0, 1.0);
+    return ((x < 0 ? -mag : mag) * 0.5 + 0.5) * 65535.0;
+}
+
+static void checkInterpolation(const CurveConfig &config)
+{
+    ResponseCurve curve;
+    curve.configure(config);
+    const double segment = 1.0 / ResponseCurve::SEGMENTS;
+    for (uint32_t in = 0; in <= 65535; ++in)
+    {
+        uint32_t idx = in >> 8;
+        double lo = reference(config, idx * segment), hi = reference(config, (idx + 1) * segment);
+        double expected = lo + (hi - lo) * (in & 0xff) / 256.0;
+        char msg[64];
+        snprintf(msg, sizeof(msg), "c %d d %u e %u r %u in %u", config.center, config.deadband, config.expo,
+                 config.rate, in);
+        TEST_ASSERT_INT_WITHIN_MESSAGE(1, lround(expected), curve.apply(in), msg);
+    }
+}
+
+static void checkCurve(const CurveConfig &config)
+{
+    ResponseCurve curve;
+    curve.configure(config);
+    for (uint32_t in = 0; in <= 65535; ++in)
+    {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "e %u r %u in %u", config.expo, config.rate, in);
+        TEST_ASSERT_INT_WITHIN_MESSAGE(3, lround(reference(config, in / 65536.0)), curve.apply(in), msg);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+// A linear curve is bypassed by the mapper, but through the table it stays the identity
+static void test_linear_is_identity()
+{
+    ResponseCurve curve;
+    for (uint32_t in = 0; in <= 65535; ++in)
+        TEST_ASSERT_INT_WITHIN(1, in, curve.apply(in));
+}
+
+static void test_interpolation_all_settings()
+{
+    static const int8_t centers[] = {-25, -10, 0, 7, 25};
+    static const uint8_t deadbands[] = {0, 5, 50};
+    static const uint8_t expos[] = {0, 30, 100};
+    static const uint8_t rates[] = {50, 100, 150, 200};
+    for (int8_t c : centers)
+        for (uint8_t d : deadbands)
+            for (uint8_t e : expos)
+                for (uint8_t r : rates)
+                    checkInterpolation({c, d, e, r});
+}
+
+static void test_smooth_curves_match_reference()
+{
+    for (uint8_t e = 0; e <= 100; e += 10)
+        for (uint8_t r = 10; r <= 100; r += 10)
+            checkCurve({0, 0, e, r});
+}
+
+// configure() keeps every setting in its range
+static void test_configure_clamps()
+{
+    ResponseCurve curve;
+    curve.configure({-100, 200, 250, 255});
+    TEST_ASSERT_EQUAL_INT(-25, curve.getConfig().center);
+    TEST_ASSERT_EQUAL_UINT8(50, curve.getConfig().deadband);
+    TEST_ASSERT_EQUAL_UINT8(100, curve.getConfig().expo);
+    TEST_ASSERT_EQUAL_UINT8(200, curve.getConfig().rate);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_linear_is_identity);
+    RUN_TEST(test_interpolation_all_settings);
+    RUN_TEST(test_smooth_curves_match_reference);
+    RUN_TEST(test_configure_clamps);
+    return UNITY_END();
+}
@@ -0,0 +1,118 @@
+#include <unity.h>
+#include <Sim.h>
+#include <CrsfBaudProbe.h>
+
+// The simulation in src/sim as a test. Every scenario is a command line for simMain(), which fails
+// when one of the run's own checks does, and the SimResult has to show the run did what it claims.
+// The firmware's globals live for the whole process, the scenarios run one after the other on it
+// like on a joystick that stays plugged in while the receivers change.
+
+enum eScenario
+{
+    SIM_REBAUD,
+    SIM_SPLIT,
+    SIM_FORWARD,
+    SIM_BLACKBOX_OUTAGE,
+    SIM_BLACKBOX_SAMPLED,
+    SIM_DIVERSITY,
+    SIM_SCENARIOS
+};
+
+static const char *const scenarios[SIM_SCENARIOS][16] = {
+    {"--seconds", "4", "--rate", "500", "--baud", "420000", "--rebaud", "115200"},
+    {"--seconds", "4", "--rate", "500", "--baud", "420000", "--split", "20"},
+    {"--seconds", "3", "--rate", "1000", "--baud", "420000", "--noise", "10", "--forward-ts", ""},
+    {"--seconds", "3", "--rate", "500", "--baud", "420000", "--noise", "5", "--outage", "200", "--blackbox", ""},
+    {"--seconds", "10", "--rate", "500", "--baud", "420000", "--noise", "5", "--blackbox", ""},
+    {"--seconds", "4", "--rate", "500", "--baud", "420000", "--rx2", "1200"},
+};
+
+static SimResult run(uint8_t scenario)
+{
+    const char *argv[17] = {"program"};
+    int argc = 1;
+    for (const char *const *arg = scenarios[scenario]; *arg; ++arg)
+        argv[argc++] = *arg;
+
+    SimResult res;
+    TEST_ASSERT_EQUAL_INT(0, simMain(argc, argv, &res));
+    TEST_ASSERT_GREATER_THAN_UINT32(0, res.frames);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, res.reports);
+    return res;
+}
+
+void setUp() {}
+void tearDown() {}
+
+// The receivers drop to 115200 halfway, the first one has to find the new rate within a full search
+static void test_rebaud_relocks()
+{
+    SimResult res = run(SIM_REBAUD);
+    TEST_ASSERT_EQUAL_UINT32(115200, res.baud);
+    TEST_ASSERT_GREATER_OR_EQUAL_INT32(0, res.relockMs);
+    TEST_ASSERT_LESS_OR_EQUAL_INT32(CrsfBaudProbe::LOCK_TIMEOUT_MS + CrsfBaudProbe::RATE_COUNT * CrsfBaudProbe::DWELL_MS,
+                                    res.relockMs);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, res.rcDecoded);
+}
+
+// A fifth of the frames stall halfway for longer than the idle gap, those and only those have to be dropped
+static void test_split_frames_dropped()
+{
+    SimResult res = run(SIM_SPLIT);
+    TEST_ASSERT_GREATER_THAN_UINT32(res.frames / 10, res.splitFrames);
+    TEST_ASSERT_EQUAL_UINT32(res.wholeFrames, res.rcDecoded);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(res.splitFrames, res.gapDrops);
+    TEST_ASSERT_GREATER_THAN_UINT32(res.frames / 2, res.wholeFrames);
+}
+
+// Timestamped forwarding at 1 kHz with corrupted frames on the line, only whole valid frames may reach USB
+static void test_forward_stream_parses()
+{
+    SimResult res = run(SIM_FORWARD);
+    TEST_ASSERT_EQUAL_UINT32(0, res.forwardLeftover);
+    // A corrupted frame may still arrive whole if only garbage followed it
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(res.frames - res.corrupted, res.forwardedRc);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(res.frames, res.forwardedRc);
+    // The link statistics after every 50th frame
+    TEST_ASSERT_GREATER_THAN_UINT32(0, res.forwardedOther);
+}
+
+// Outages every second, the link events keep every frame in the blackbox
+static void test_blackbox_keeps_outages()
+{
+    SimResult res = run(SIM_BLACKBOX_OUTAGE);
+    TEST_ASSERT_TRUE(res.blackboxMatches);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(4, res.blackboxEvents);
+    TEST_ASSERT_GREATER_THAN_UINT32(res.frames / 2, res.blackboxFrames);
+}
+
+// A steady link, past the first events the blackbox only samples the frames
+static void test_blackbox_samples_steady_link()
+{
+    SimResult res = run(SIM_BLACKBOX_SAMPLED);
+    TEST_ASSERT_TRUE(res.blackboxMatches);
+    // All of the run fits, in a fraction of the frames
+    TEST_ASSERT_GREATER_THAN_UINT32(9500, res.blackboxSpanMs);
+    TEST_ASSERT_LESS_THAN_UINT32(res.frames / 2, res.blackboxFrames);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, res.blackboxLinks);
+}
+
+// The second receiver is 1.2 ms late at 500 Hz, more than half a period, its copies must not go out again
+static void test_diversity_forwards_each_packet_once()
+{
+    SimResult res = run(SIM_DIVERSITY);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(res.packets, res.diversityForwarded);
+    TEST_ASSERT_GREATER_THAN_UINT32(res.packets * 9 / 10, res.diversityForwarded);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_rebaud_relocks);
+    RUN_TEST(test_split_frames_dropped);
+    RUN_TEST(test_forward_stream_parses);
+    RUN_TEST(test_blackbox_keeps_outages);
+    RUN_TEST(test_blackbox_samples_steady_link);
+    RUN_TEST(test_diversity_forwards_each_packet_once);
+    return UNITY_END();
+}